@@ -0,0 +1,66 @@
+#!/bin/sh
+# Runs each benchmark scenario against a fresh staticdwm built with METRICS on
+# a private Xvfb server and prints one line per metric:
+#
+#     scenario name calls p50_us p99_us max_us xrequests
+#
+# Lines named client.* are timed by benchclient, the others are the metrics
+# file of the window manager. BENCHN scales the scenarios, BENCHDISPLAY picks
+# the display to use.
+dir=$(dirname "$0")
+n=${BENCHN:-500}
+disp=${BENCHDISPLAY:-:97}
+
+command -v Xvfb >/dev/null || { echo "bench: Xvfb not found" >&2; exit 1; }
+XDG_RUNTIME_DIR=$(mktemp -d) || exit 1
+DISPLAY=$disp
+export XDG_RUNTIME_DIR DISPLAY
+Xvfb "$disp" -screen 0 1920x1080x24 -nolisten tcp 2>/dev/null &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null; rm -rf "$XDG_RUNTIME_DIR"' EXIT INT TERM
+
+# run scenario args...: one window manager session driven by benchclient
+run() {
+	scenario=$1
+	shift
+	"$dir"/staticdwm-metrics 2>/dev/null &
+	wm=$!
+	"$dir"/benchclient wait 0 || exit 1
+	"$dir"/benchclient "$@" | sed "s/^/$scenario /"
+	sleep 1 # let the window manager work through the queued input
+	kill -TERM $wm
+	wait $wm
+	grep -v '^#' "$XDG_RUNTIME_DIR/staticdwm-metrics$disp" | sed "s/^/$scenario /"
+}
+
+# hotplug: the root window changes size under a set of mapped windows
+hotplug() {
+	"$dir"/staticdwm-metrics 2>/dev/null &
+	wm=$!
+	"$dir"/benchclient hold 32 | sed "s/^/hotplug /" &
+	client=$!
+	sleep 1
+	i=0
+	while [ $i -lt $((n / 10)) ]; do
+		xrandr --fb 1280x720 2>/dev/null
+		xrandr --fb 1920x1080 2>/dev/null
+		i=$((i + 1))
+	done
+	sleep 1
+	kill -TERM $wm
+	wait $wm
+	kill $client 2>/dev/null
+	grep -v '^#' "$XDG_RUNTIME_DIR/staticdwm-metrics$disp" | sed "s/^/hotplug /"
+}
+
+echo "# scenario name calls p50_us p99_us max_us xrequests"
+run map map "$n"
+run view view "$n"
+run fill fill "$n"
+run frames frames "$n"
+run titles titles $((n * 20))
+if command -v xrandr >/dev/null; then
+	hotplug
+else
+	echo "bench: xrandr not found, hotplug skipped" >&2
+fi
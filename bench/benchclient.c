@@ -0,0 +1,193 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * benchclient drives one benchmark scenario against the window manager
+ * running on $DISPLAY and prints its own timings in the format of the
+ * metrics file, see bench.sh. Key presses go through XTest and assume the
+ * bindings of config.def.h. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+
+#include "../util.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define NWINS                   64 /* windows to work on for key scenarios */
+
+static Display *dpy;
+static Window root;
+static Window *wins;
+static int nwins;
+static long long *lat; /* client side latencies, microseconds */
+static int nlat;
+
+/* nowus() {{{*/
+static long long nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}/*}}}*/
+/* cmplat() {{{*/
+static int cmplat(const void *a, const void *b)
+{
+	long long d = *(const long long *)a - *(const long long *)b;
+
+	return d < 0 ? -1 : d > 0;
+}/*}}}*/
+/* report() {{{*/
+/* prints the latencies collected as one metrics line */
+static void report(const char *name)
+{
+	if (!nlat)
+		return;
+	qsort(lat, nlat, sizeof *lat, cmplat);
+	printf("client.%s %d %lld %lld %lld -\n", name, nlat,
+		lat[(nlat - 1) / 2], lat[(nlat - 1) * 99 / 100], lat[nlat - 1]);
+	nlat = 0;
+}/*}}}*/
+/* openwins() {{{*/
+/* maps n windows, timing each from XMapWindow() until the WM mapped it */
+static void openwins(int n)
+{
+	XSetWindowAttributes wa = { .event_mask = StructureNotifyMask };
+	XEvent ev;
+	long long t;
+	int i;
+
+	wins = ecalloc(n, sizeof *wins);
+	lat = ecalloc(n, sizeof *lat);
+	for (i = 0; i < n; i++) {
+		wins[i] = XCreateWindow(dpy, root, 0, 0, 200, 100, 0, CopyFromParent,
+			InputOutput, CopyFromParent, CWEventMask, &wa);
+		XStoreName(dpy, wins[i], "benchclient");
+		t = nowus();
+		XMapWindow(dpy, wins[i]);
+		do
+			XWindowEvent(dpy, wins[i], StructureNotifyMask, &ev);
+		while (ev.type != MapNotify);
+		lat[nlat++] = nowus() - t;
+	}
+	nwins = n;
+}/*}}}*/
+/* key() {{{*/
+/* presses and releases sym with Mod1 held */
+static void key(KeySym sym)
+{
+	KeyCode mod = XKeysymToKeycode(dpy, XK_Alt_L);
+	KeyCode code = XKeysymToKeycode(dpy, sym);
+
+	XTestFakeKeyEvent(dpy, mod, True, CurrentTime);
+	XTestFakeKeyEvent(dpy, code, True, CurrentTime);
+	XTestFakeKeyEvent(dpy, code, False, CurrentTime);
+	XTestFakeKeyEvent(dpy, mod, False, CurrentTime);
+	XSync(dpy, False);
+}/*}}}*/
+/* keys() {{{*/
+/* presses the n syms in turn, count times, and reports the rate */
+static void keys(const char *name, const KeySym *syms, int n, int count)
+{
+	long long t = nowus();
+	int i;
+
+	for (i = 0; i < count; i++)
+		key(syms[i % n]);
+	t = nowus() - t;
+	printf("client.%s %d %lld - - -\n", name, count, t / (count ? count : 1));
+}/*}}}*/
+/* titles() {{{*/
+/* changes the titles of all windows count times in total */
+static void titles(int count)
+{
+	Atom netname = XInternAtom(dpy, "_NET_WM_NAME", False);
+	Atom utf8 = XInternAtom(dpy, "UTF8_STRING", False);
+	char name[64];
+	long long t = nowus();
+	int i;
+
+	for (i = 0; i < count; i++) {
+		snprintf(name, sizeof name, "benchclient title %d", i);
+		XChangeProperty(dpy, wins[i % nwins], netname, utf8, 8,
+			PropModeReplace, (unsigned char *)name, strlen(name));
+		if (i % 64 == 63)
+			XFlush(dpy);
+	}
+	XSync(dpy, False);
+	t = nowus() - t;
+	printf("client.titles %d %lld - - -\n", count, t / (count ? count : 1));
+}/*}}}*/
+/* waitwm() {{{*/
+/* waits until a window manager set _NET_SUPPORTING_WM_CHECK on the root */
+static void waitwm(void)
+{
+	Atom check = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
+	Atom type;
+	int format, i;
+	unsigned long n, extra;
+	unsigned char *p;
+
+	for (i = 0; i < 500; i++, usleep(10000)) {
+		p = NULL;
+		if (XGetWindowProperty(dpy, root, check, 0, 1, False, XA_WINDOW, &type,
+			&format, &n, &extra, &p) == Success && p) {
+			XFree(p);
+			if (n)
+				return;
+		}
+	}
+	die("benchclient: no window manager");
+}/*}}}*/
+/* main() {{{*/
+int main(int argc, char *argv[])
+{
+	static const KeySym tagkeys[] = { XK_1, XK_2, XK_3, XK_4 };
+	static const KeySym fillkeys[] = { XK_k, XK_k, XK_j };
+	/* open frames, keep one, close it */
+	static const KeySym framekeys[] = { XK_h, XK_h, XK_h, XK_o, XK_r };
+	int n, i, di;
+
+	if (argc != 3)
+		die("usage: benchclient wait|map|hold|view|fill|frames|titles n");
+	n = MAX(atoi(argv[2]), 0);
+	for (i = 0; i < 500 && !(dpy = XOpenDisplay(NULL)); i++)
+		usleep(10000);
+	if (!dpy)
+		die("benchclient: cannot open display");
+	if (!XTestQueryExtension(dpy, &di, &di, &di, &di))
+		die("benchclient: no XTest extension");
+	root = DefaultRootWindow(dpy);
+	waitwm();
+	if (!strcmp(argv[1], "wait"))
+		;
+	else if (!strcmp(argv[1], "map")) {
+		openwins(n);
+		report("map");
+	} else if (!strcmp(argv[1], "hold")) {
+		openwins(n);
+		report("map");
+		fflush(stdout);
+		pause(); /* until killed */
+	} else if (!strcmp(argv[1], "view")) {
+		openwins(NWINS);
+		keys("view", tagkeys, LENGTH(tagkeys), n);
+	} else if (!strcmp(argv[1], "fill")) {
+		openwins(NWINS);
+		keys("fillframe", fillkeys, LENGTH(fillkeys), n);
+	} else if (!strcmp(argv[1], "frames")) {
+		openwins(NWINS);
+		keys("frames", framekeys, LENGTH(framekeys), n);
+	} else if (!strcmp(argv[1], "titles")) {
+		openwins(NWINS);
+		titles(n);
+	} else
+		die("benchclient: unknown scenario %s", argv[1]);
+	XCloseDisplay(dpy);
+	return EXIT_SUCCESS;
+}/*}}}*/
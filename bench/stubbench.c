@@ -0,0 +1,449 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * stubbench runs the window manager logic against xstub instead of a server.
+ * It includes staticdwm.c to reach its static functions, calls them the way
+ * the bindings of config.def.h would, and reports the rate of each operation
+ * with the requests it issued. An operation, with the commit() after it,
+ * that issues more requests or round trips than its budget, or that makes
+ * the object pools grow once it ran, makes stubbench fail, as does a check
+ * of the behaviour the operations do not show, run before them. */
+#define main staticdwm_main
+#define RUNKEY(K)               (keytrace[nkeytrace++ % 16] = (K) - keys)
+
+static unsigned int keytrace[16], nkeytrace; /* keys[] run by keypress() */
+
+#include "../staticdwm.c"
+#undef main
+
+#include "xstub.h"
+
+#define NWINS                   64 /* windows managed before the operations */
+#define FREECODE                200 /* without a symbol on a US keyboard */
+
+typedef struct {
+	const char *name;
+	int (*check)(void); /* returns 0 after reporting a failure */
+} Check;
+
+typedef struct {
+	struct {
+		int type;
+		Window win; /* 1 for root */
+	} ev[4];      /* the queue, up to the first type 0 */
+	int hoisted;  /* index of the event hoistinput() takes, -1 for none */
+} HoistCase;
+
+typedef struct {
+	const char *name;
+	void (*step)(unsigned long i);
+	unsigned long requests, roundtrips; /* budget per operation */
+} Op;
+
+static int checkhoist(void);
+static int checkhoistqueue(XEvent *q, int n, int want);
+static int checkkeys(void);
+static int checkrules(void);
+static int checkgrabs(unsigned long want);
+static XEvent hoistevent(int type, Window w);
+static unsigned long poolblocks(void);
+static void stepfill(unsigned long i);
+static void stepfocus(unsigned long i);
+static void stepframes(unsigned long i);
+static void stephide(unsigned long i);
+static void stepmap(unsigned long i);
+static void steptitle(unsigned long i);
+static void stepview(unsigned long i);
+
+static const Op benchops[] = {
+	/* name        step        requests  round trips */
+	{ "view",      stepview,   68,       1 },
+	{ "fillframe", stepfill,   68,       1 },
+	{ "focusframe", stepfocus, 48,       0 },
+	{ "frames",    stepframes, 48,       0 },
+	{ "title",     steptitle,  1,        1 },
+	{ "map",       stepmap,    118,      10 },
+	{ "hide",      stephide,   193,      4 },
+};
+static const Check benchchecks[] = {
+	{ "hoist",     checkhoist },
+	{ "keys",      checkkeys },
+	{ "rules",     checkrules },
+};
+static const HoistCase hoistcases[] = {
+	{ { { KeyPress, 1 } }, 0 },
+	{ { { PropertyNotify, 5 }, { ConfigureRequest, 6 }, { KeyPress, 1 } }, 2 },
+	{ { { PropertyNotify, 1 }, { PropertyNotify, 1 }, { KeyPress, 1 } }, 2 },
+	{ { { Expose, 9 }, { PropertyNotify, 5 }, { ButtonPress, 9 } }, -1 },
+	{ { { PropertyNotify, 5 }, { ButtonPress, 6 }, { KeyPress, 1 } }, 1 },
+	{ { { PropertyNotify, 5 }, { MappingNotify, 0 } }, 1 },
+	{ { { EnterNotify, 7 }, { KeyPress, 1 } }, -1 },
+	{ { { PropertyNotify, 5 }, { MapRequest, 8 }, { KeyPress, 1 } }, -1 },
+	{ { { PropertyNotify, 5 }, { ButtonPress, 5 }, { KeyPress, 1 } }, -1 },
+	{ { { PropertyNotify, 5 }, { Expose, 6 } }, -1 },
+};
+/* overlapping patterns, ending on one state, empty and missing ones */
+static const Rule rulecases[] = {
+	{ .class = "ab" },
+	{ .class = "b" },
+	{ .class = "abc" },
+	{ .instance = "b", .title = "ab" },
+	{ 0 },
+	{ .class = "", .instance = "ab" },
+	{ .class = "ab", .title = "" },
+	{ .class = "b", .instance = "b", .title = "b" },
+	{ .class = "bab", .instance = "ca" },
+	{ .title = "abc" },
+	{ .class = "cc", .title = "bc" },
+};
+/* the names checkrules() tries, each with the others */
+static const char *rulenames[] = {
+	"", "a", "b", "c", "ab", "ba", "bc", "ca", "cc", "abc", "bab", "xabcx",
+	"cab", "aab", "bcab", "ccbc",
+};
+static Window benchwins[NWINS];
+
+/* benchclock() {{{*/
+static double benchclock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}/*}}}*/
+/* checkgrabs() {{{*/
+/* runs grabkeys(), which must grab and ungrab want keys */
+static int checkgrabs(unsigned long want)
+{
+	xstubreset();
+	grabkeys();
+	if (xstubcount("XGrabKey") == want && xstubcount("XUngrabKey") == want)
+		return 1;
+	fprintf(stderr, "stubbench: keys: %lu grabs and %lu ungrabs, %lu expected\n",
+		xstubcount("XGrabKey"), xstubcount("XUngrabKey"), want);
+	return 0;
+}/*}}}*/
+/* checkhoist() {{{*/
+/* hands hoistinput() the queues of hoistcases[], and one with a window more
+ * than it keeps apart */
+static int checkhoist(void)
+{
+	XEvent q[HOISTWINS + 2];
+	unsigned int i;
+	int n;
+
+	for (i = 0; i < LENGTH(hoistcases); i++) {
+		for (n = 0; n < LENGTH(hoistcases[i].ev) && hoistcases[i].ev[n].type; n++)
+			q[n] = hoistevent(hoistcases[i].ev[n].type, hoistcases[i].ev[n].win);
+		if (!checkhoistqueue(q, n, hoistcases[i].hoisted)) {
+			fprintf(stderr, "stubbench: hoist: case %u failed\n", i);
+			return 0;
+		}
+	}
+	for (n = 0; n < HOISTWINS; n++)
+		q[n] = hoistevent(PropertyNotify, 10 + n);
+	q[n] = hoistevent(KeyPress, 1);
+	if (!checkhoistqueue(q, n + 1, n))
+		return 0;
+	q[n] = hoistevent(PropertyNotify, 10 + n);
+	q[n + 1] = hoistevent(KeyPress, 1);
+	if (!checkhoistqueue(q, n + 2, -1)) {
+		fprintf(stderr, "stubbench: hoist: %d windows kept apart\n", n + 1);
+		return 0;
+	}
+	return 1;
+}/*}}}*/
+/* checkhoistqueue() {{{*/
+/* expects hoistinput() to take the event want of the n queued in q, or none
+ * for -1, and to leave the others queued */
+static int checkhoistqueue(XEvent *q, int n, int want)
+{
+	XEvent ev, orig[HOISTWINS + 2];
+	int i;
+
+	memcpy(orig, q, n * sizeof *q);
+	xstubqueue(q, n);
+	if (!hoistinput(&ev)) {
+		xstubqueue(NULL, 0);
+		return want == -1;
+	}
+	xstubqueue(NULL, 0);
+	if (want == -1 || memcmp(&ev, orig + want, sizeof ev))
+		return 0;
+	for (i = 0; i < n - 1; i++)
+		if (memcmp(q + i, orig + i + (i >= want), sizeof *q))
+			return 0;
+	return 1;
+}/*}}}*/
+/* checkkeys() {{{*/
+/* moves the symbol of the first key to another keycode and back, which must
+ * only regrab the bindings of that symbol, and presses every binding, which
+ * must run the bindings of its keycode and modifiers in keys[] order */
+static int checkkeys(void)
+{
+	XEvent ev = { .xkey = { .type = KeyPress } };
+	KeySym sym = keys[0].keysym;
+	KeyCode code = XKeysymToKeycode(dpy, sym);
+	unsigned int i, j, k, mask, mods[LENGTH(keys)], nmods = 0;
+
+	for (i = 0; i < LENGTH(keys); i++) {
+		for (j = 0; j < nmods && mods[j] != keys[i].mod; j++);
+		if (keys[i].keysym == sym && j == nmods)
+			mods[nmods++] = keys[i].mod;
+	}
+	nmods *= numlockmask ? 4 : 2; /* with LockMask and numlockmask */
+	if (!checkgrabs(0))
+		return 0;
+	xstubsetkey(code, NoSymbol);
+	xstubsetkey(FREECODE, sym);
+	if (!checkgrabs(nmods))
+		return 0;
+	xstubsetkey(FREECODE, NoSymbol);
+	xstubsetkey(code, sym);
+	if (!checkgrabs(nmods))
+		return 0;
+	for (i = 0; i < LENGTH(keys); i++) {
+		if (!(ev.xkey.keycode = XKeysymToKeycode(dpy, keys[i].keysym)))
+			continue;
+		ev.xkey.state = keys[i].mod | LockMask;
+		mask = CLEANMASK(keys[i].mod);
+		nkeytrace = 0;
+		keypress(&ev);
+		for (j = k = 0; j < LENGTH(keys); j++)
+			if (keys[j].func && keys[j].keysym == keys[i].keysym
+			&& CLEANMASK(keys[j].mod) == mask && keytrace[k++ % 16] != j)
+				break;
+		if (j < LENGTH(keys) || k != nkeytrace) {
+			fprintf(stderr, "stubbench: keys: binding %u ran %u bindings,"
+				" not those of keys[] in order\n", i, nkeytrace);
+			return 0;
+		}
+	}
+	return 1;
+}/*}}}*/
+/* checkrules() {{{*/
+/* compiles rulecases[] and compares, for every combination of rulenames[],
+ * the rules matchrules() finds with those a search of each pattern finds */
+static int checkrules(void)
+{
+	const char *name[RuleLast], *p;
+	unsigned int i, j, f, r, n, want[LENGTH(rulecases)], nwant;
+	int ret = 1;
+
+	compilerules(rulecases, LENGTH(rulecases));
+	n = LENGTH(rulenames);
+	for (i = 0; ret && i < n * n * n; i++) {
+		name[RuleClass] = rulenames[i % n];
+		name[RuleInstance] = rulenames[i / n % n];
+		name[RuleTitle] = rulenames[i / n / n];
+		for (nwant = r = 0; r < LENGTH(rulecases); r++) {
+			for (f = 0; f < RuleLast; f++)
+				if ((p = rulefield(rulecases + r, f)) && !strstr(name[f], p))
+					break;
+			if (f == RuleLast)
+				want[nwant++] = r;
+		}
+		if (matchrules(name[RuleClass], name[RuleInstance], name[RuleTitle])
+			!= nwant || memcmp(rulematched, want, nwant * sizeof *want)) {
+			fprintf(stderr, "stubbench: rules: class \"%s\" instance \"%s\""
+				" title \"%s\" matched %u rules, not", name[RuleClass],
+				name[RuleInstance], name[RuleTitle], nrulematched);
+			for (j = 0; j < nwant; j++)
+				fprintf(stderr, " %u", want[j]);
+			fputc('\n', stderr);
+			ret = 0;
+		}
+	}
+	compilerules(rules, LENGTH(rules));
+	return ret;
+}/*}}}*/
+/* hoistevent() {{{*/
+/* an event of type about w, root for 1 */
+static XEvent hoistevent(int type, Window w)
+{
+	XEvent ev = { .type = type };
+
+	w = w == 1 ? root : w;
+	switch (type) {
+	case ConfigureRequest: ev.xconfigurerequest.parent = root;
+		ev.xconfigurerequest.window = w; break;
+	case MapRequest: ev.xmaprequest.parent = root;
+		ev.xmaprequest.window = w; break;
+	case KeyPress: ev.xkey.root = root; /* fall through */
+	default: ev.xany.window = w; break;
+	}
+	return ev;
+}/*}}}*/
+/* mapwin() {{{*/
+/* hands w to maprequest() as if its client mapped it */
+static void mapwin(Window w)
+{
+	XEvent ev = { .xmaprequest = { .type = MapRequest, .window = w } };
+
+	maprequest(&ev);
+}/*}}}*/
+/* poolblocks() {{{*/
+static unsigned long poolblocks(void)
+{
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i < PoolLast; i++)
+		n += pools[i].nblocks;
+	return n;
+}/*}}}*/
+/* stepfill() {{{*/
+static void stepfill(unsigned long i)
+{
+	static const int dir[] = { +1, +1, -1 };
+	Arg a = { .i = dir[i % LENGTH(dir)] };
+
+	fillframe(&a);
+}/*}}}*/
+/* stepfocus() {{{*/
+static void stepfocus(unsigned long i)
+{
+	Arg a = { .ui = 1 + i % (NFRAMES - 1) };
+
+	focusframe(&a);
+}/*}}}*/
+/* stepframes() {{{*/
+/* opens all frames, moves through them, keeps one and closes it */
+static void stepframes(unsigned long i)
+{
+	static const Arg last = { .ui = NFRAMES - 1 }, next = { .i = +1 };
+
+	switch (i % 5) {
+	case 0: focusframe(&last); break;
+	case 3: onlyframe(NULL); break;
+	case 4: closeframe(NULL); break;
+	default: toggleframe(&next); break;
+	}
+}/*}}}*/
+/* stephide() {{{*/
+/* with one frame open, unmaps the client it shows by viewing another tag
+ * with the client set to HideUnmap, hands unmapnotify() the events the server
+ * would report to the window and to root, and views its tag again */
+static void stephide(unsigned long i)
+{
+	static const Arg away = { .ui = 1 }, back = { .ui = 0 }, first = { .ui = 1 };
+	XEvent ev = { .xunmap = { .type = UnmapNotify } };
+	Client *c;
+
+	if (i == 0) {
+		focusframe(&first);
+		view(&back);
+		onlyframe(NULL);
+		commit();
+	}
+	if (!(c = SELECTED(selmon)))
+		die("stubbench: no client to hide");
+	c->hide = HideUnmap;
+	view(&away);
+	commit();
+	if (c->hidden != HideUnmap)
+		die("stubbench: hide did not unmap the client");
+	ev.xunmap.window = ev.xunmap.event = c->win;
+	unmapnotify(&ev);
+	ev.xunmap.event = root;
+	unmapnotify(&ev);
+	if (wintoclient(ev.xunmap.window) != c || c->ignoreunmap)
+		die("stubbench: hide unmanaged the client");
+	view(&back);
+}/*}}}*/
+/* stepmap() {{{*/
+/* maps a new window and destroys it again */
+static void stepmap(unsigned long i)
+{
+	XEvent ev = { .xdestroywindow = { .type = DestroyNotify } };
+
+	ev.xdestroywindow.window = xstubwindow("stubbench");
+	mapwin(ev.xdestroywindow.window);
+	commit();
+	destroynotify(&ev);
+}/*}}}*/
+/* steptitle() {{{*/
+static void steptitle(unsigned long i)
+{
+	XEvent ev = { .xproperty = { .type = PropertyNotify, .atom = XA_WM_NAME,
+		.state = PropertyNewValue } };
+	char name[64];
+
+	ev.xproperty.window = benchwins[i % NWINS];
+	snprintf(name, sizeof name, "stubbench title %lu", i);
+	xstubsetname(ev.xproperty.window, name);
+	propertynotify(&ev);
+}/*}}}*/
+/* stepview() {{{*/
+static void stepview(unsigned long i)
+{
+	Arg a = { .ui = i % NTAGS };
+
+	view(&a);
+}/*}}}*/
+/* main() {{{*/
+int main(int argc, char *argv[])
+{
+	const Check *ck;
+	const Op *op;
+	unsigned long i, n = 100000, rq, rt, maxrq, maxrt, blocks = 0;
+	int verbose = 0, ret = EXIT_SUCCESS;
+	double t;
+
+	for (i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-v"))
+			verbose = 1;
+		else if ((n = strtoul(argv[i], NULL, 10)) == 0)
+			die("usage: stubbench [-v] [operations]");
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("stubbench: cannot open display");
+	setup();
+	scan();
+	updatefrmpos(selmon);
+	arrange(selmon);
+	for (i = 0; i < NWINS; i++) {
+		stepview(i);
+		mapwin(benchwins[i] = xstubwindow("stubbench"));
+	}
+	commit();
+	for (ck = benchchecks; ck < benchchecks + LENGTH(benchchecks); ck++)
+		if (!ck->check()) {
+			fprintf(stderr, "stubbench: check %s failed\n", ck->name);
+			ret = EXIT_FAILURE;
+		}
+	printf("# name ops ops_per_s requests_per_op max_requests"
+		" roundtrips_per_op max_roundtrips\n");
+	for (op = benchops; op < benchops + LENGTH(benchops); op++) {
+		xstubreset();
+		maxrq = maxrt = 0;
+		t = benchclock();
+		for (i = 0; i < n; i++) {
+			rq = xstubrequests;
+			rt = xstubroundtrips;
+			op->step(i);
+			commit();
+			maxrq = MAX(maxrq, xstubrequests - rq);
+			maxrt = MAX(maxrt, xstubroundtrips - rt);
+			if (i == 0)
+				blocks = poolblocks();
+		}
+		t = benchclock() - t;
+		printf("stub.%s %lu %.0f %.2f %lu %.2f %lu\n", op->name, n, n / t,
+			(double)xstubrequests / n, maxrq, (double)xstubroundtrips / n, maxrt);
+		if (verbose)
+			xstubdump(stdout, "  ", n);
+		if (maxrq > op->requests || maxrt > op->roundtrips) {
+			fprintf(stderr, "stubbench: %s over budget, %lu requests and %lu"
+				" round trips, at most %lu and %lu allowed\n", op->name, maxrq,
+				maxrt, op->requests, op->roundtrips);
+			ret = EXIT_FAILURE;
+		}
+		if (poolblocks() != blocks) {
+			fprintf(stderr, "stubbench: %s allocated %lu pool blocks after its"
+				" first run\n", op->name, poolblocks() - blocks);
+			ret = EXIT_FAILURE;
+		}
+	}
+	cleanup();
+	XCloseDisplay(dpy);
+	return ret;
+}/*}}}*/
@@ -0,0 +1,490 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Link time stand-ins for the X libraries, see xstub.h. Windows answer as
+ * freshly mapped 640x480 windows without properties, except for the names
+ * set through xstubsetname(), the keyboard has one symbol per keycode, laid
+ * out as a US keyboard unless xstubsetkey() changed it, and no events
+ * arrive but those xstubqueue() hands XCheckIfEvent(). */
+#define XLIB_ILLEGAL_ACCESS /* for the layout of Display */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xft/Xft.h>
+#ifdef XINERAMA
+#include <X11/extensions/Xinerama.h>
+#endif /* XINERAMA */
+
+#include "../util.h"
+#include "xstub.h"
+
+#define WINBASE                 0x200000 /* first resource id handed out */
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define REQUEST(N, RT)          do { static Req r; count(&r, __func__, (N), (RT)); } while (0)
+
+typedef struct Req Req;
+struct Req {
+	const char *name;
+	unsigned long n;
+	Req *next;
+};
+
+unsigned long xstubrequests, xstubroundtrips, xstubflushes;
+
+static Display *display;
+static Screen screen;
+static Visual visual;
+static Req *reqs;
+static XID nextid = WINBASE;
+static char **names; /* by resource id - WINBASE */
+static size_t nnames;
+static XErrorHandler errorhandler;
+static char dummy; /* target of the opaque handles */
+static XEvent *queue; /* see xstubqueue() */
+static int nqueue;
+static KeySym keymap[256] = { /* by keycode */
+	[9] = XK_Escape, [10] = XK_1, [11] = XK_2, [12] = XK_3, [13] = XK_4,
+	[14] = XK_5, [15] = XK_6, [16] = XK_7, [17] = XK_8, [18] = XK_9,
+	[19] = XK_0, [20] = XK_minus, [21] = XK_equal, [22] = XK_BackSpace,
+	[23] = XK_Tab, [24] = XK_q, [25] = XK_w, [26] = XK_e, [27] = XK_r,
+	[28] = XK_t, [29] = XK_y, [30] = XK_u, [31] = XK_i, [32] = XK_o,
+	[33] = XK_p, [36] = XK_Return, [38] = XK_a, [39] = XK_s, [40] = XK_d,
+	[41] = XK_f, [42] = XK_g, [43] = XK_h, [44] = XK_j, [45] = XK_k,
+	[46] = XK_l, [50] = XK_Shift_L, [52] = XK_z, [53] = XK_x, [54] = XK_c,
+	[55] = XK_v, [56] = XK_b, [57] = XK_n, [58] = XK_m, [59] = XK_comma,
+	[60] = XK_period, [61] = XK_slash, [64] = XK_Alt_L, [65] = XK_space,
+	[66] = XK_Caps_Lock, [77] = XK_Num_Lock,
+};
+
+/* count() {{{*/
+/* adds n requests issued by name, the last of them waiting for a reply if rt */
+static void count(Req *r, const char *name, unsigned long n, int rt)
+{
+	if (!r->name) {
+		r->name = name;
+		r->next = reqs;
+		reqs = r;
+	}
+	r->n += n;
+	xstubrequests += n;
+	xstubroundtrips += rt;
+	if (display)
+		display->request += n;
+}/*}}}*/
+/* newid() {{{*/
+static XID newid(void)
+{
+	return nextid++;
+}/*}}}*/
+/* xstubcount() {{{*/
+/* returns the requests name issued since xstubreset() */
+unsigned long xstubcount(const char *name)
+{
+	Req *r;
+
+	for (r = reqs; r; r = r->next)
+		if (!strcmp(r->name, name))
+			return r->n;
+	return 0;
+}/*}}}*/
+/* xstubdump() {{{*/
+/* prints the requests counted since xstubreset(), per operation */
+void xstubdump(FILE *f, const char *prefix, unsigned long ops)
+{
+	Req *r;
+
+	for (r = reqs; r; r = r->next)
+		if (r->n)
+			fprintf(f, "%s%s %.2f\n", prefix, r->name, (double)r->n / (ops ? ops : 1));
+}/*}}}*/
+/* xstubqueue() {{{*/
+/* queues the n events of ev, in place, for XCheckIfEvent() only, which
+ * removes the event it returns from them */
+void xstubqueue(XEvent *ev, int n)
+{
+	queue = ev;
+	nqueue = n;
+}/*}}}*/
+/* xstubreset() {{{*/
+void xstubreset(void)
+{
+	Req *r;
+
+	for (r = reqs; r; r = r->next)
+		r->n = 0;
+	xstubrequests = xstubroundtrips = xstubflushes = 0;
+}/*}}}*/
+/* xstubsetkey() {{{*/
+/* gives code the symbol sym, NoSymbol for none, as a new keyboard mapping */
+void xstubsetkey(KeyCode code, KeySym sym)
+{
+	if (code >= 8)
+		keymap[code] = sym;
+}/*}}}*/
+/* xstubsetname() {{{*/
+/* sets the title w answers with, NULL for none */
+void xstubsetname(Window w, const char *name)
+{
+	size_t i = w - WINBASE;
+
+	if (w < WINBASE || w >= nextid)
+		return;
+	if (i >= nnames) {
+		names = realloc(names, (i + 64) * sizeof *names);
+		if (!names)
+			die("xstub: cannot realloc");
+		memset(names + nnames, 0, (i + 64 - nnames) * sizeof *names);
+		nnames = i + 64;
+	}
+	free(names[i]);
+	names[i] = name ? strdup(name) : NULL;
+}/*}}}*/
+/* xstubwindow() {{{*/
+/* a new client window, as if created by another connection */
+Window xstubwindow(const char *name)
+{
+	Window w = newid();
+
+	xstubsetname(w, name);
+	return w;
+}/*}}}*/
+/* Display {{{*/
+Display *XOpenDisplay(_Xconst char *name)
+{
+	if (display)
+		return display;
+	display = ecalloc(1, sizeof *display);
+	display->fd = -1;
+	display->display_name = "xstub";
+	display->nscreens = 1;
+	display->screens = &screen;
+	screen.display = display;
+	screen.root = newid();
+	screen.width = 1920;
+	screen.height = 1080;
+	screen.root_depth = 24;
+	screen.root_visual = &visual;
+	screen.cmap = newid();
+	visual.class = TrueColor;
+	return display;
+}
+int XCloseDisplay(Display *dpy)
+{
+	size_t i;
+
+	for (i = 0; i < nnames; i++)
+		free(names[i]);
+	free(names);
+	names = NULL;
+	nnames = 0;
+	free(display);
+	display = NULL;
+	return 0;
+}
+int XFlush(Display *dpy) { xstubflushes++; return 1; }
+int XSync(Display *dpy, Bool discard) { REQUEST(1, 1); xstubflushes++; return 1; }
+int XPending(Display *dpy) { return 0; }
+int XNextEvent(Display *dpy, XEvent *ev) { die("xstub: no events to wait for"); return 0; }
+int XMaskEvent(Display *dpy, long mask, XEvent *ev) { die("xstub: no events to wait for"); return 0; }
+Bool XCheckMaskEvent(Display *dpy, long mask, XEvent *ev) { return False; }
+Bool XCheckIfEvent(Display *dpy, XEvent *ev, Bool (*pred)(Display *, XEvent *,
+	XPointer), XPointer arg)
+{
+	int i;
+
+	for (i = 0; i < nqueue; i++)
+		if (pred(dpy, queue + i, arg)) {
+			*ev = queue[i];
+			memmove(queue + i, queue + i + 1, (--nqueue - i) * sizeof *queue);
+			return True;
+		}
+	return False;
+}
+Bool XSupportsLocale(void) { return True; }
+int XFree(void *p) { free(p); return 1; }
+XErrorHandler XSetErrorHandler(XErrorHandler h)
+{
+	XErrorHandler old = errorhandler;
+
+	errorhandler = h;
+	return old;
+}
+Status XInternAtoms(Display *dpy, char **names, int n, Bool onlyifexists, Atom *atoms)
+{
+	static Atom next = XA_LAST_PREDEFINED + 1;
+	int i;
+
+	REQUEST(n, 1);
+	for (i = 0; i < n; i++)
+		atoms[i] = next++;
+	return 1;
+}
+/*}}}*/
+/* Windows {{{*/
+Window XCreateSimpleWindow(Display *dpy, Window parent, int x, int y, unsigned int w,
+	unsigned int h, unsigned int bw, unsigned long border, unsigned long bg)
+{
+	REQUEST(1, 0);
+	return newid();
+}
+Window XCreateWindow(Display *dpy, Window parent, int x, int y, unsigned int w,
+	unsigned int h, unsigned int bw, int depth, unsigned int class, Visual *visual,
+	unsigned long mask, XSetWindowAttributes *wa)
+{
+	REQUEST(1, 0);
+	return newid();
+}
+int XDestroyWindow(Display *dpy, Window w) { REQUEST(1, 0); return 1; }
+int XMapWindow(Display *dpy, Window w) { REQUEST(1, 0); return 1; }
+int XMapRaised(Display *dpy, Window w) { REQUEST(2, 0); return 1; }
+int XUnmapWindow(Display *dpy, Window w) { REQUEST(1, 0); return 1; }
+int XConfigureWindow(Display *dpy, Window w, unsigned int mask, XWindowChanges *wc) { REQUEST(1, 0); return 1; }
+int XMoveWindow(Display *dpy, Window w, int x, int y) { REQUEST(1, 0); return 1; }
+int XRestackWindows(Display *dpy, Window *w, int n) { REQUEST(1, 0); return 1; }
+int XMoveResizeWindow(Display *dpy, Window w, int x, int y, unsigned int width,
+	unsigned int height) { REQUEST(1, 0); return 1; }
+int XSetWindowBorder(Display *dpy, Window w, unsigned long pixel) { REQUEST(1, 0); return 1; }
+int XChangeWindowAttributes(Display *dpy, Window w, unsigned long mask,
+	XSetWindowAttributes *wa) { REQUEST(1, 0); return 1; }
+int XSelectInput(Display *dpy, Window w, long mask) { REQUEST(1, 0); return 1; }
+int XDefineCursor(Display *dpy, Window w, Cursor cursor) { REQUEST(1, 0); return 1; }
+int XSetInputFocus(Display *dpy, Window w, int revert, Time time) { REQUEST(1, 0); return 1; }
+int XKillClient(Display *dpy, XID id) { REQUEST(1, 0); return 1; }
+int XSetCloseDownMode(Display *dpy, int mode) { REQUEST(1, 0); return 1; }
+int XWarpPointer(Display *dpy, Window src, Window dst, int sx, int sy,
+	unsigned int sw, unsigned int sh, int dx, int dy) { REQUEST(1, 0); return 1; }
+Status XSendEvent(Display *dpy, Window w, Bool propagate, long mask, XEvent *ev) { REQUEST(1, 0); return 1; }
+Status XGetWindowAttributes(Display *dpy, Window w, XWindowAttributes *wa)
+{
+	REQUEST(2, 1); /* the attributes and the geometry */
+	memset(wa, 0, sizeof *wa);
+	wa->width = 640;
+	wa->height = 480;
+	wa->depth = screen.root_depth;
+	wa->visual = &visual;
+	wa->root = screen.root;
+	wa->map_state = IsViewable;
+	wa->screen = &screen;
+	return 1;
+}
+Status XQueryTree(Display *dpy, Window w, Window *root, Window *parent,
+	Window **children, unsigned int *n)
+{
+	REQUEST(1, 1);
+	*root = *parent = screen.root;
+	*children = NULL;
+	*n = 0;
+	return 1;
+}
+Bool XQueryPointer(Display *dpy, Window w, Window *root, Window *child, int *rx,
+	int *ry, int *x, int *y, unsigned int *mask)
+{
+	REQUEST(1, 1);
+	*root = screen.root;
+	*child = None;
+	*rx = *ry = *x = *y = 0;
+	*mask = 0;
+	return True;
+}
+/*}}}*/
+/* Properties {{{*/
+int XChangeProperty(Display *dpy, Window w, Atom prop, Atom type, int format,
+	int mode, _Xconst unsigned char *data, int n) { REQUEST(1, 0); return 1; }
+int XDeleteProperty(Display *dpy, Window w, Atom prop) { REQUEST(1, 0); return 1; }
+int XGetWindowProperty(Display *dpy, Window w, Atom prop, long off, long len,
+	Bool delete, Atom req, Atom *type, int *format, unsigned long *n,
+	unsigned long *after, unsigned char **data)
+{
+	REQUEST(1, 1);
+	*type = None;
+	*format = 0;
+	*n = *after = 0;
+	*data = NULL;
+	return Success;
+}
+Status XGetTextProperty(Display *dpy, Window w, XTextProperty *text, Atom prop)
+{
+	size_t i = w - WINBASE;
+
+	REQUEST(1, 1);
+	if (w < WINBASE || i >= nnames || !names[i])
+		return 0;
+	text->value = (unsigned char *)strdup(names[i]);
+	text->encoding = XA_STRING;
+	text->format = 8;
+	text->nitems = strlen(names[i]);
+	return 1;
+}
+int XmbTextPropertyToTextList(Display *dpy, const XTextProperty *text, char ***list,
+	int *n) { return XNoMemory; }
+void XFreeStringList(char **list) { free(list); }
+Status XGetClassHint(Display *dpy, Window w, XClassHint *ch) { REQUEST(1, 1); return 0; }
+int XSetClassHint(Display *dpy, Window w, XClassHint *ch) { REQUEST(1, 0); return 1; }
+XWMHints *XGetWMHints(Display *dpy, Window w) { REQUEST(1, 1); return NULL; }
+int XSetWMHints(Display *dpy, Window w, XWMHints *wmh) { REQUEST(1, 0); return 1; }
+XWMHints *XAllocWMHints(void) { return ecalloc(1, sizeof(XWMHints)); }
+Status XGetWMNormalHints(Display *dpy, Window w, XSizeHints *hints, long *supplied)
+{
+	REQUEST(1, 1);
+	*supplied = 0;
+	return 0;
+}
+Status XGetTransientForHint(Display *dpy, Window w, Window *trans) { REQUEST(1, 1); return 0; }
+Status XGetWMProtocols(Display *dpy, Window w, Atom **protocols, int *n) { REQUEST(1, 1); return 0; }
+/*}}}*/
+/* Input {{{*/
+int XGrabKey(Display *dpy, int code, unsigned int mods, Window w, Bool owner,
+	int pmode, int kmode) { REQUEST(1, 0); return 1; }
+int XUngrabKey(Display *dpy, int code, unsigned int mods, Window w) { REQUEST(1, 0); return 1; }
+int XGrabButton(Display *dpy, unsigned int button, unsigned int mods, Window w,
+	Bool owner, unsigned int mask, int pmode, int kmode, Window confine,
+	Cursor cursor) { REQUEST(1, 0); return 1; }
+int XUngrabButton(Display *dpy, unsigned int button, unsigned int mods, Window w) { REQUEST(1, 0); return 1; }
+int XGrabPointer(Display *dpy, Window w, Bool owner, unsigned int mask, int pmode,
+	int kmode, Window confine, Cursor cursor, Time time) { REQUEST(1, 1); return GrabSuccess; }
+int XUngrabPointer(Display *dpy, Time time) { REQUEST(1, 0); return 1; }
+int XGrabServer(Display *dpy) { REQUEST(1, 0); return 1; }
+int XUngrabServer(Display *dpy) { REQUEST(1, 0); return 1; }
+int XAllowEvents(Display *dpy, int mode, Time time) { REQUEST(1, 0); return 1; }
+XModifierKeymap *XGetModifierMapping(Display *dpy)
+{
+	XModifierKeymap *map = ecalloc(1, sizeof *map);
+
+	REQUEST(1, 1);
+	map->max_keypermod = 1;
+	map->modifiermap = ecalloc(8, sizeof *map->modifiermap);
+	return map;
+}
+int XFreeModifiermap(XModifierKeymap *map)
+{
+	free(map->modifiermap);
+	free(map);
+	return 1;
+}
+int XRefreshKeyboardMapping(XMappingEvent *ev) { return 1; }
+KeyCode XKeysymToKeycode(Display *dpy, KeySym sym)
+{
+	int code;
+
+	for (code = 8; code < LENGTH(keymap); code++)
+		if (sym != NoSymbol && keymap[code] == sym)
+			return code;
+	return 0;
+}
+int XDisplayKeycodes(Display *dpy, int *min, int *max)
+{
+	*min = 8;
+	*max = 255;
+	return 1;
+}
+KeySym *XGetKeyboardMapping(Display *dpy, KeyCode first, int n, int *per)
+{
+	KeySym *syms = ecalloc(n, sizeof(KeySym));
+	int i;
+
+	REQUEST(1, 1);
+	*per = 1;
+	for (i = 0; i < n && first + i < LENGTH(keymap); i++)
+		syms[i] = keymap[first + i];
+	return syms;
+}
+char *XKeysymToString(KeySym sym) { return "stub"; }
+/*}}}*/
+/* Drawing {{{*/
+Pixmap XCreatePixmap(Display *dpy, Drawable d, unsigned int w, unsigned int h,
+	unsigned int depth)
+{
+	REQUEST(1, 0);
+	return newid();
+}
+int XFreePixmap(Display *dpy, Pixmap p) { REQUEST(1, 0); return 1; }
+GC XCreateGC(Display *dpy, Drawable d, unsigned long mask, XGCValues *gcv)
+{
+	REQUEST(1, 0);
+	return ecalloc(1, sizeof(struct _XGC));
+}
+int XFreeGC(Display *dpy, GC gc) { REQUEST(1, 0); free(gc); return 1; }
+/* GC changes are counted as if each were flushed on its own */
+int XSetForeground(Display *dpy, GC gc, unsigned long pixel) { REQUEST(1, 0); return 1; }
+int XSetLineAttributes(Display *dpy, GC gc, unsigned int w, int line, int cap,
+	int join) { REQUEST(1, 0); return 1; }
+int XCopyArea(Display *dpy, Drawable src, Drawable dst, GC gc, int sx, int sy,
+	unsigned int w, unsigned int h, int dx, int dy) { REQUEST(1, 0); return 1; }
+int XFillRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w,
+	unsigned int h) { REQUEST(1, 0); return 1; }
+int XDrawRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w,
+	unsigned int h) { REQUEST(1, 0); return 1; }
+Cursor XCreateFontCursor(Display *dpy, unsigned int shape)
+{
+	REQUEST(2, 0); /* the cursor font is opened once per cursor */
+	return newid();
+}
+int XFreeCursor(Display *dpy, Cursor cursor) { REQUEST(1, 0); return 1; }
+/*}}}*/
+/* Xft and fontconfig {{{*/
+XftFont *XftFontOpenName(Display *dpy, int screen, _Xconst char *name)
+{
+	XftFont *f = ecalloc(1, sizeof *f);
+
+	REQUEST(1, 1);
+	f->ascent = 11;
+	f->descent = 3;
+	f->height = 14;
+	f->max_advance_width = 7;
+	return f;
+}
+XftFont *XftFontOpenPattern(Display *dpy, FcPattern *pattern)
+{
+	return XftFontOpenName(dpy, 0, NULL);
+}
+FcPattern *XftFontMatch(Display *dpy, int screen, _Xconst FcPattern *pattern,
+	FcResult *result) { *result = FcResultNoMatch; return NULL; }
+void XftFontClose(Display *dpy, XftFont *f) { free(f); }
+FcBool XftCharExists(Display *dpy, XftFont *f, FcChar32 ucs4) { return FcTrue; }
+void XftTextExtentsUtf8(Display *dpy, XftFont *f, _Xconst FcChar8 *s, int len,
+	XGlyphInfo *ext)
+{
+	int i, n = 0;
+
+	for (i = 0; i < len; i++)
+		n += (s[i] & 0xc0) != 0x80;
+	memset(ext, 0, sizeof *ext);
+	ext->width = ext->xOff = n * f->max_advance_width;
+	ext->height = f->height;
+}
+Bool XftColorAllocName(Display *dpy, _Xconst Visual *v, Colormap cmap,
+	_Xconst char *name, XftColor *color)
+{
+	REQUEST(1, 1);
+	memset(color, 0, sizeof *color);
+	color->pixel = strlen(name);
+	color->color.alpha = 0xffff;
+	return True;
+}
+XftDraw *XftDrawCreate(Display *dpy, Drawable d, Visual *v, Colormap cmap)
+{
+	return (XftDraw *)&dummy;
+}
+void XftDrawDestroy(XftDraw *draw) {}
+void XftDrawStringUtf8(XftDraw *draw, _Xconst XftColor *color, XftFont *f, int x,
+	int y, _Xconst FcChar8 *s, int len) { REQUEST(1, 0); }
+FcPattern *FcNameParse(const FcChar8 *name) { return (FcPattern *)&dummy; }
+FcPattern *FcPatternDuplicate(const FcPattern *p) { return (FcPattern *)&dummy; }
+void FcPatternDestroy(FcPattern *p) {}
+FcBool FcPatternAddBool(FcPattern *p, const char *object, FcBool b) { return FcTrue; }
+FcBool FcPatternAddCharSet(FcPattern *p, const char *object, const FcCharSet *c) { return FcTrue; }
+FcBool FcConfigSubstitute(FcConfig *config, FcPattern *p, FcMatchKind kind) { return FcTrue; }
+void FcDefaultSubstitute(FcPattern *p) {}
+FcCharSet *FcCharSetCreate(void) { return (FcCharSet *)&dummy; }
+void FcCharSetDestroy(FcCharSet *c) {}
+FcBool FcCharSetAddChar(FcCharSet *c, FcChar32 ucs4) { return FcTrue; }
+/*}}}*/
+#ifdef XINERAMA
+/* Xinerama {{{*/
+Bool XineramaIsActive(Display *dpy) { REQUEST(1, 1); return False; }
+XineramaScreenInfo *XineramaQueryScreens(Display *dpy, int *n) { REQUEST(1, 1); *n = 0; return NULL; }
+/*}}}*/
+#endif /* XINERAMA */
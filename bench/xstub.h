@@ -0,0 +1,16 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * xstub replaces, at link time, every Xlib, Xft, Xinerama and fontconfig
+ * call the window manager makes. No server is involved: requests are only
+ * counted, by name, and the calls that would wait for a reply also count as
+ * round trips. */
+
+extern unsigned long xstubrequests, xstubroundtrips, xstubflushes;
+
+unsigned long xstubcount(const char *name);
+void xstubdump(FILE *f, const char *prefix, unsigned long ops);
+void xstubqueue(XEvent *ev, int n);
+void xstubreset(void);
+void xstubsetkey(KeyCode code, KeySym sym);
+void xstubsetname(Window w, const char *name);
+Window xstubwindow(const char *name);
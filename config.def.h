@@ -46,11 +46,22 @@ static const Rule rules[] = {
 	 *	WM_CLASS(STRING) = instance, class
 	 *	WM_NAME(STRING) = title
 	 */
-	/* set tag as -1 to not specify */
-	/* class      instance    title       tag     isfloating   monitor */
-	{ "Gimp",     NULL,       NULL,       -1,            0,          -1 },
-	{ "Firefox",  NULL,		  NULL,		   2,			 0,			 -1 },
+	/* set tag as -1 to not specify, hide as HideDefault for hidepolicy */
+	/* class      instance    title       tag     isfloating   monitor   hide */
+	{ "Gimp",     NULL,       NULL,       -1,            0,          -1,   HideDefault },
+	{ "Firefox",  NULL,		  NULL,		   2,			 0,			 -1,   HideDefault },
 };
+/* HideMove parks clients no frame shows off screen, HideUnmap unmaps them
+ * and sets them iconic, which lets most stop drawing */
+static const int hidepolicy = HideMove;
+/* 1 means title changes apply the tag and floating of the title rules the
+ * new title matches */
+static const int retitlerules = 0;
+/* ms at least between fetches of the titles the frames of a monitor show */
+static const unsigned int titleinterval = 100;
+/* 1 means key and button presses go ahead of queued PropertyNotify,
+ * ConfigureRequest and Expose events about other windows */
+static const int inputfirst = 1;
 
 /* layout(s) */
 static const int resizehints = 1;/*1 means respect size hints in tiled resize*/
@@ -78,6 +89,8 @@ static const char *termcmd[] = { "st", NULL };
 /* commands called when frames are opened or closed, first command when no
  * frames are left open, second when one, etc. MUST define as NULL for no hooks.*/
 static const char **framehooks[] = {NULL, NULL, NULL, NULL};
+/* milliseconds a frame hook waits, so quick frame changes only run the last */
+static const unsigned int framehookdelay = 100;
 
 /* Below is an example use which loads a different background for each layout.
 static const char *bgcmd[] = {"feh","--bg-scale","/home/michael/bg.jpg",NULL};
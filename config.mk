@@ -14,6 +14,27 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# XCB backend for requests with replies, comment for plain Xlib
+XCBLIBS  = -lX11-xcb -lxcb
+XCBFLAGS = -DXCB
+
+# latency histograms written to $XDG_RUNTIME_DIR/staticdwm-metrics<display>
+# every 10s and on SIGUSR1, uncomment to measure
+#METRICSFLAGS = -DMETRICS
+
+# record and replay of sessions with -r and -p, uncomment to use
+#RECORDFLAGS = -DRECORD
+
+# XSync round trip counting, printed on exit, uncomment to catch regressions
+#SYNCFLAGS = -DCOUNTSYNC
+
+# frame contents and bar counts, which are kept incrementally, checked on every
+# commit, for debugging
+#CHECKFLAGS = -DCHECKFRMS
+
+# XTest, for the client driving make bench
+BENCHLIBS = -lXtst
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -22,10 +43,10 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS}
+LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${XCBLIBS} ${FREETYPELIBS}
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=2 -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XCBFLAGS} ${METRICSFLAGS} ${RECORDFLAGS} ${SYNCFLAGS} ${CHECKFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = -s ${LIBS}
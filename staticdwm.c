@@ -22,12 +22,17 @@
  */
 /* Include {{{*/
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -41,11 +46,47 @@
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
 #include <X11/Xft/Xft.h>
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif /* XCB */
 #include "drw.h"
 #include "util.h"
 /*}}}*/
+/* Sync counting {{{*/
+#ifdef COUNTSYNC
+static unsigned long nsyncs;
+#define XSync(D, B)             (nsyncs++, XSync((D), (B)))
+#endif /* COUNTSYNC */
+/*}}}*/
+/* Metrics {{{*/
+#ifdef METRICS
+#define NBUCKETS                24 /* log2 microseconds, the last is open */
+#define METRICSEVERY            10000 /* ms between metrics exports */
+#define METRIC_BEGIN(T)         long long T##us = nowus(); \
+                                unsigned long T##rq = NextRequest(dpy)
+#define METRIC_END(M, T)        metricadd((M), T##us, T##rq)
+#else
+#define METRIC_BEGIN(T)
+#define METRIC_END(M, T)
+#endif /* METRICS */
+/*}}}*/
+/* Record and replay {{{*/
+#ifdef RECORD
+#define RECDATA(P, L)           recdata((P), (L))
+#define RECBATCH()              writerec('B', NULL, 0)
+#define XMaskEvent(D, M, E)     recmaskevent((D), (M), (E))
+#else
+#define RECDATA(P, L)
+#define RECBATCH()
+#endif /* RECORD */
+/*}}}*/
 /* Macros {{{*/
 #define NFRAMES					(MAXTILEDFRAMES + 1)
+#define EVBATCH					256 /* max events drained per batch */
+#define HOISTWINS				32 /* windows hoistinput() keeps apart */
+#define POOLBLOCK				64 /* objects a pool allocates at once */
+#define SELTITLELEN				16 /* bytes of the selected title in the bar */
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
 #define CLEANMASK(mask)         (mask & ~(numlockmask|LockMask) &\
 		(ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask))
@@ -54,11 +95,20 @@
 								* MAX(0, MIN((y)+(h),(m)->wy+(m)->wh)\
 								* - MAX((y),(m)->wy)))
 #define SELECTED(M)				((M)->frames[(M)->selfrm].last)
+#define TAGLIST(C)				((C)->isfloating ? NTAGS : (C)->tag)
+#define OPENFRMS(M)				((2U << (M)->nopenfrms) - 2) /* frms bits */
 #define FOCUSED(M)				((M)->frames[(M)->focfrm].last)
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
+#define WINHASH(W)              (((unsigned int)(W) * 2654435761U)\
+								>> (32 - wintabbits))
+#define KEYHASH(C, M)           ((((unsigned int)(C) << 8 | (M)) * 2654435761U)\
+								>> (32 - keytabbits))
+#ifndef RUNKEY /* stubbench traces the bindings instead */
+#define RUNKEY(K)               (K)->func(&(K)->arg)
+#endif
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
 #define SETBORDERCOL(X)		 	XSetWindowBorder(dpy, (X)->win,\
 			scheme[c->isfloating ? SchemeFlFoc : SchemeFoc][ColBorder].pixel);
@@ -66,20 +116,45 @@
 /*}}}*/
 /* Enumerators {{{*/
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
+enum { DirtyArrange = 1, DirtyRestack = 2, DirtyBar = 4 }; /* monitor work */
+enum { FocusClean, FocusRefocus, FocusNothing }; /* pending focus work */
+enum { ListClients = 1, ListStacking = 2 }; /* root client lists to update */
+enum { GrabNone, GrabUnfocused, GrabFocused }; /* client button grabs */
+enum { RuleClass, RuleInstance, RuleTitle, RuleLast }; /* rule fields */
+enum { HideDefault, HideMove, HideUnmap }; /* hiding clients no frame shows */
 enum { SchemeNorm, SchemeSel, SchemeFoc,
 	   SchemeFlNorm, SchemeFlSel, SchemeFlFoc}; /* color schemes */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast }; /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetClientListStacking,
+       NetWMHidden,
+       NetLast }; /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast };/* default atoms */
+enum { PfTransient, PfNetName, PfName, PfClass, PfNetState, PfWinType,
+	   PfNormalHints, PfHints, PfState, PfProtocols,
+	   PfLast }; /* prefetched properties */
 enum { ClkTagBar, ClkFrmBar, ClkStatusText, ClkWinTitle, ClkClientWin,
 	   ClkRootWin, ClkLast, ClkFrm }; /* clicks */
+enum { MetArrange, MetRestack, MetDrawbar, MetManage, MetInput,
+	   MetLast }; /* timed steps */
+enum { PoolClient, PoolCold, PoolLink, PoolLast }; /* object pools */
 /*}}}*/
 /* Forward definitions {{{*/
 typedef struct Monitor Monitor;
 typedef struct ClientLink ClientLink;
 typedef struct Client Client;
+typedef struct ClientCold ClientCold;
+typedef struct Title Title;
+typedef struct Pool Pool;
 typedef struct Frame Frame;
+typedef struct WinSlot WinSlot;
+typedef struct KeySlot KeySlot;
+typedef struct RuleNode RuleNode;
+typedef struct EvKey EvKey;
+typedef struct Hoist Hoist;
+typedef struct Timer Timer;
+typedef struct Prefetch Prefetch;
+typedef struct Metric Metric;
 /*}}}*/
 /* Structures needed for config.h {{{*/
 /* Arg {{{*/
@@ -115,6 +190,7 @@ typedef struct {
 	int tag;
 	int isfloating;
 	int monitor;
+	int hide; /* HideDefault for hidepolicy */
 } Rule;
 /*}}}*/
 /*}}}*/
@@ -128,11 +204,18 @@ static void attach(Client *c);
 static void attachfocus(Client * c);
 static void attachstack(Client *c);
 static void buttonpress(XEvent *e);
+static void canceltimer(Timer *t);
+#ifdef CHECKFRMS
+static void checkfrms(void);
+#endif /* CHECKFRMS */
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
+static void compilerules(const Rule *r, unsigned int n);
 static int clicktoframe(Monitor *m, float fx, float fy);
 static void clientmessage(XEvent *e);
+static void coalesceevents(void);
+static void commit(void);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
@@ -141,35 +224,109 @@ static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static void discardbatched(int type);
+static void dispatch(XEvent *ev);
 static void drawbar(Monitor *m);
 static void drawbars(void);
+static void drainevents(void);
 static void enternotify(XEvent *e);
+static Window evwindow(XEvent *ev);
 static void exchangeframecontents(unsigned int a, unsigned int b);
 static void expose(XEvent *e);
+static void fetchtitle(Client *c);
+static void fetchtitles(void);
 static void refocus(void);
 static void focusclient(Client *c);
 static void focusin(XEvent *e);
 static void focusnothing(void);
+static void freerules(void);
+static Atom getatomprop(Client *c, Atom prop);
+static int getattributes(Window w, XWindowAttributes *wa);
+static int getclasshint(Window w, char **class, char **instance);
+#ifdef XCB
+static xcb_get_property_reply_t *getprop(Window w, Atom prop, uint32_t len);
+#endif /* XCB */
+static unsigned int getprotocols(Window w);
 static int getrootptr(int *x, int *y);
+static int getsizehints(Window w, XSizeHints *size);
 static long getstate(Window w);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static int gettransient(Window w, Window *trans);
+static XWMHints *getwmhints(Window w);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
+static int grabcmp(const void *a, const void *b);
+static void handlesignals(void);
+static Bool hoistable(Display *d, XEvent *ev, XPointer arg);
+static int hoistinput(XEvent *ev);
+static void indexwin(Window w, Client *c, Monitor *m);
+#ifdef METRICS
+static long long inputstart(Time t);
+#endif /* METRICS */
 static int isavailable(Client * c);
 static int isfloating(Client * c);
 static int isinfrm(Client * c);
 static void keypress(XEvent *e);
+static void listclient(Window w);
+static WinSlot *lookupwin(Window w);
 static void manage(Window w, XWindowAttributes *wa);
+static void markurgent(Client *c, int urg);
+static unsigned int matchrules(const char *class, const char *instance,
+	const char *title);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
+#ifdef METRICS
+static void metricadd(Metric *m, long long us, unsigned long rq);
+#endif /* METRICS */
 static void motionnotify(XEvent *e);
+static int nexttimeout(void);
+static long long nowms(void);
+#ifdef METRICS
+static long long nowus(void);
+#endif /* METRICS */
+static void paintbar(Monitor *m);
+static void pfrelease(Prefetch *pf);
+static unsigned int placeclient(Client *c, int x, int y);
+static void poolclear(Pool *p);
+static void *poolget(Pool *p);
+static void poolput(Pool *p, void *o);
+static void prefetch(Prefetch *pf, Window w);
+static void printstats(void);
 static void propertynotify(XEvent *e);
+#ifdef RECORD
+static void readevent(XEvent *ev);
+static void *readrec(int kind, size_t *len);
+static void recdata(void *p, size_t len);
+static void recevent(XEvent *ev);
+static void recmapwins(void);
+static int recmaskevent(Display *d, long mask, XEvent *ev);
+static void recopen(const char *path, int replay);
+static void recstr(char **s);
+static int recwindows(int ok, Window **wins, unsigned int *num);
+static XWMHints *recwmhints(XWMHints *wmh);
+#endif /* RECORD */
 static Monitor *recttomon(int x, int y, int w, int h);
+#ifdef XCB
+static void requestmodmap(void);
+#endif /* XCB */
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void restack(Monitor *m);
+static void restackmon(Monitor *m);
 static void restacksel(void);
+static void retag(Client *c);
+static void retitle(Client *c);
+#ifdef RECORD
+static void replay(void);
+#endif /* RECORD */
+static const char *rulefield(const Rule *r, int f);
+static void rulehits(int f, unsigned int hit);
+static void rulescan(int f, const char *text);
+static unsigned int rulestep(const RuleNode *nodes, unsigned int s,
+	unsigned char c);
 static void run(void);
+static void runframehook(Timer *t);
+static void runtimers(void);
 static void scan(void);
 static int sendevent(Client *c, Atom proto);
 static void sendmon(Client *c, Monitor *m);
@@ -178,15 +335,30 @@ static void setclientstate(Client *c, long state);
 static void setfocfrm(Monitor * m, unsigned int frm);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
+static Client *setlast(Monitor *m, unsigned int f, Client *c);
+static void setnetstate(Client *c);
 static void setopenframes(Monitor *m, unsigned int nf);
 static void setselfrm(Monitor * m, unsigned int frm);
+static void settimer(Timer *t, unsigned int ms);
 static void setup(void);
 static void seturgent(Client *c, int urg);
-static void showhide(Client *c);
-static void sigchld(int unused);
+static void showhide(Monitor *m);
+static void sighandler(int sig);
+static void tagattach(Client *c);
+static void tagdetach(Client *c);
+static void tagstackattach(Client *c);
+static void tagstackdetach(Client *c);
+static char *textprop(Window w, Atom atom);
+static Title *titleget(const char *s);
+static void titleput(Title *t);
+static unsigned int titleshown(const char *s, unsigned int w);
+static void titletimeout(Timer *t);
 static void unfocus(Client *c, int setfocus);
+static void unindexwin(Window w);
+static void unlistclient(Window w);
 static void unmanage(Client *c, int destroyed);
 static void unmapnotify(XEvent *e);
+static void unstackwin(Monitor *m, Window w);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
 static void updateborder(Client *c, int bw);
@@ -197,10 +369,17 @@ static void updatenumlockmask(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
 static void updatewindowtype(Client *c);
-static void updatetitle(Client *c);
+static Title *updatetitle(Client *c);
 static void updatewmhints(Client *c);
+static int waitevents(void);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
+#ifdef METRICS
+static void writemetrics(Timer *t);
+#endif /* METRICS */
+#ifdef RECORD
+static void writerec(int kind, const void *p, size_t len);
+#endif /* RECORD */
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
@@ -245,19 +424,40 @@ struct Frame {
 };
 /*}}}*/
 /* Client {{{*/
+/* what the list walks read comes first, in one cache line */
 struct Client {
-	char name[256];
+	Client *next, *snext, *tnext, *tsnext; /* tnext, tsnext: lists of tlist */
+	Window win;
+	Monitor *mon;
+	unsigned int tag;
+	unsigned int tlist; /* TAGLIST() when linked */
+	unsigned int frms; /* bit per frame of mon showing it, see setlast() */
+	int isfloating;
+	Client *sprev, *tprev, *tsprev;
+	int x, y, w, h, bw;
+	int ax, ay, aw, ah, abw; /* geometry last sent, see placeclient() */
+	int isfixed, isurgent, neverfocus, isfullscreen;
+	unsigned int lastfrm;
+	unsigned int protocols; /* WM_PROTOCOLS, bit per wmatom index */
+	int grabbed; /* buttons grabbed by grabbuttons() */
+	int titlestale; /* changed since fetched, see fetchtitles() */
+	int hide; /* policy of its rules, HideDefault for hidepolicy */
+	int hidden; /* how showhide() hid it, 0 if shown */
+	unsigned int ignoreunmap; /* UnmapNotify of unmaps by showhide(), 2 each */
+	Client *focusto;
+	ClientLink *focusfrom;
+	Title *name; /* see titleget() */
+	ClientCold *cold;
+};/*}}}*/
+/* ClientCold {{{*/
+/* read on resizes and floating or fullscreen toggles only */
+struct ClientCold {
 	float mina, maxa;
-	int x, y, w, h;
 	int oldx, oldy, oldw, oldh;
 	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
-	int bw, oldbw;
-	unsigned int tag, lastfrm;
-	int isfixed, isurgent, neverfocus, isfloating, isfullscreen;
-	Client *next, *snext, *sprev, *focusto;
-	ClientLink *focusfrom;
-	Monitor *mon;
-	Window win;
+	int oldbw;
+	Title *class, *instance; /* for retitle(), with retitlerules */
+	unsigned int titlerule; /* last title rule applied, +1 */
 };/*}}}*/
 /* Monitor {{{*/
 struct Monitor {
@@ -267,24 +467,127 @@ struct Monitor {
 	int wx, wy, ww, wh;   /* window area  */
 	/* max x positions for bar features to turn click position to action */
 	int btagx[NTAGS], bfrmx[NFRAMES], bseltitlex;
+	unsigned int bfoctitlelen; /* focused title bytes shown, 0 for all */
 	int nopenfrms;
 	unsigned int selfrm, focfrm, selfrmold, focfrmold;
 	int showbar;
 	int topbar;
+	unsigned int dirty;   /* work deferred to commit() */
+	long long titlesdue;  /* ms, fetchtitles() waits until then */
 	Client *clients;
 	Client *stack;
 	Client *stacklast;
+	/* clients and stack per tag, floating clients last, in the same order */
+	Client *tagclients[NTAGS + 1], *tagclientslast[NTAGS + 1];
+	Client *tagstack[NTAGS + 1];
+	unsigned int ntag[NTAGS + 1], nurgent[NTAGS + 1]; /* for the bar */
 	Monitor *next;
 	Window barwin;
+	/* order restackmon() applied, top first, then room for the next one */
+	Window *stacked;
+	unsigned int nstacked, nstackedmax;
 	Frame frames[NFRAMES];
 };
 /*}}}*/
+/* WinSlot {{{*/
+/* window index entry, c is set for client windows, m for bar windows. client
+ * entries resolve their monitor through c->mon, so sendmon() and updategeom()
+ * moving clients between monitors leave the index valid */
+struct WinSlot {
+	Window win;
+	Client *c;
+	Monitor *m;
+};/*}}}*/
+/* KeySlot {{{*/
+/* key binding entry, for a keycode and the CLEANMASK() of the modifiers */
+struct KeySlot {
+	unsigned int code;  /* 0 for a free slot */
+	unsigned int mask;
+	unsigned int key;   /* index in keys[] */
+};/*}}}*/
+/* RuleNode {{{*/
+/* state of the Aho-Corasick automaton finding the patterns one field of
+ * rules[] has, states are indices in rulenodes[field] and 0 is the root */
+struct RuleNode {
+	unsigned int child, sibling; /* first child, next child of the parent */
+	unsigned int fail;  /* state of the longest proper suffix */
+	unsigned int dict;  /* closest fail state ending patterns, 0 for none */
+	unsigned int hit;   /* last rule whose pattern ends here, +1 */
+	unsigned char c;
+};/*}}}*/
+/* EvKey {{{*/
+/* coalescing key of a batched event, idx is the surviving event or -1 */
+struct EvKey {
+	int type;
+	Window win;
+	Atom atom;
+	int idx;
+};/*}}}*/
+/* Hoist {{{*/
+/* what hoistable() saw of the queue ahead of the event it looks at */
+struct Hoist {
+	Window wins[HOISTWINS]; /* windows of the events passed over */
+	unsigned int nwins;
+	int blocked; /* an input event had to stay behind */
+};/*}}}*/
+/* Timer {{{*/
+/* one-shot timer, owned by the subsystem using it and rearmed with settimer()
+ * from func if it should repeat */
+struct Timer {
+	long long due;        /* CLOCK_MONOTONIC milliseconds */
+	void (*func)(Timer *t);
+	Timer *next;
+	int armed;
+};/*}}}*/
+/* Prefetch {{{*/
+/* Replies manage() needs for one window, requested all at once so that
+ * managing a window, or every window in scan(), waits for one round trip
+ * instead of one per property. Without XCB only the window is recorded. */
+struct Prefetch {
+	Window win;
+#ifdef XCB
+	xcb_get_window_attributes_cookie_t attrs;
+	xcb_get_geometry_cookie_t geom;
+	xcb_get_property_cookie_t cookie[PfLast];
+	unsigned int resolved; /* bit per property, its reply was taken */
+	xcb_get_property_reply_t *reply[PfLast]; /* as taken, for later calls */
+	int attrsresolved;
+#endif /* XCB */
+};/*}}}*/
+/* Metric {{{*/
+#ifdef METRICS
+/* latency histogram of one handler, binding or step */
+struct Metric {
+	unsigned long n, reqs;  /* calls, X requests they made */
+	long long max;          /* microseconds */
+	unsigned long bucket[NBUCKETS]; /* calls taking < 1 << i microseconds */
+};
+#endif /* METRICS */
+/*}}}*/
 /* ClientLink {{{*/
 struct ClientLink {
 	Client * c;
 	ClientLink * prev;
 	ClientLink * next;
 };/*}}}*/
+/* Title {{{*/
+/* window titles, shared by the clients showing the same one */
+struct Title {
+	Title *next; /* in titles[] */
+	unsigned int hash, refs;
+	size_t len;
+	char s[];
+};/*}}}*/
+/* Pool {{{*/
+/* objects of one size handed out from blocks of POOLBLOCK and kept for reuse
+ * when put back, so managing and unmanaging windows does not malloc() */
+struct Pool {
+	const char *name;
+	size_t size;
+	void *free;     /* put back objects, linked through their first word */
+	void *blocks;   /* linked through their first word */
+	unsigned long live, peak, nblocks;
+};/*}}}*/
 /*}}}*/
 /* Variables {{{*/
 static const char broken[] = "broken";
@@ -296,6 +599,7 @@ static int bh; /* bar geometry */
 static int lrpad;            /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static int modpending = 1; /* numlockmask to be read again, from modcookie */
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
 	[ClientMessage] = clientmessage,
@@ -314,12 +618,78 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 };
 static Atom wmatom[WMLast], netatom[NetLast];
 static int running = 1;
+static Title *titles[256]; /* hash table, see titleget() */
+static Pool pools[PoolLast] = {
+	[PoolClient] = { "client", sizeof(Client) },
+	[PoolCold] = { "clientcold", sizeof(ClientCold) },
+	[PoolLink] = { "clientlink", sizeof(ClientLink) },
+};
+static int focusdirty = FocusClean;
+static unsigned int listsdirty; /* written by updateclientlist() */
+/* _NET_CLIENT_LIST in mapping order, _NET_CLIENT_LIST_STACKING as published
+ * and as built, bottom first; each of nclientwinsmax in one allocation */
+static Window *clientwins, *stackwins, *stackwinsnew;
+static unsigned int nclientwins, nstackwins, nclientwinsmax;
+static XEvent evbatch[EVBATCH]; /* events of the batch being dispatched */
+static unsigned int nevbatch, evbatchpos;
+static EvKey evkeys[2 * EVBATCH];
+static struct {
+	unsigned long batches, events, hoisted;
+	unsigned long coalesced[LASTEvent];
+} evstats;
+static struct {
+	unsigned long wakeups;
+	long long start;
+} loopstats;
+static int sigpipe[2] = {-1, -1}; /* signal handler to main loop */
+static Timer *timers; /* armed timers, soonest first */
+static Timer hooktimer = { .func = runframehook };
+static Timer titletimer = { .func = titletimeout };
+static unsigned int nstaletitles; /* clients with titlestale set */
+static const char **pendinghook; /* frame hook waiting for hooktimer */
 static Cur *cursor[CurLast];
 static Clr **scheme;
 static Display *dpy;
 static Drw *drw;
 static Monitor *mons, *selmon;
 static Window root, wmcheckwin;
+#ifdef XCB
+static xcb_connection_t *xcon;
+static Atom pfatom[PfLast]; /* the properties prefetch() requests */
+static const uint32_t pflen[PfLast] = {
+	[PfTransient] = 1, [PfNetName] = 1024, [PfName] = 1024,
+	[PfClass] = 1024, [PfNetState] = sizeof(Atom), [PfWinType] = sizeof(Atom),
+	[PfNormalHints] = 18, [PfHints] = 9, [PfState] = 2, [PfProtocols] = 16 };
+static xcb_get_modifier_mapping_cookie_t modcookie;
+#endif /* XCB */
+static Prefetch *curpf; /* replies of the window being managed */
+#ifdef METRICS
+static Metric evmetrics[LASTEvent], stepmetrics[MetLast];
+static long long inputus; /* inputstart() of the batch's input event, or 0 */
+static unsigned long inputrq;
+static Metric keymetrics[LENGTH(keys)], buttonmetrics[LENGTH(buttons)];
+static Timer metricstimer = { .func = writemetrics };
+static char metricspath[PATH_MAX]; /* empty if there is nowhere to export */
+#endif /* METRICS */
+#ifdef RECORD
+static FILE *reclog; /* session being recorded or replayed */
+static int replaying;
+static Window *recfrom, *recto; /* logged root and bar windows, current ones */
+static unsigned int nrecmap;
+#endif /* RECORD */
+static WinSlot *wintab; /* open addressed index of managed windows */
+static unsigned int wintabbits, wintabused;
+static KeySlot *keytab; /* open addressed, built by grabkeys() */
+static unsigned int keytabbits;
+static unsigned long *keygrabs; /* sorted, keycode << 16 | modifiers */
+static unsigned int nkeygrabs;
+/* compiled rules[], see compilerules(), all but rulenodes by rule */
+static RuleNode *rulenodes[RuleLast];
+static unsigned int *rulechain[RuleLast]; /* next hit, +1 */
+static unsigned char *ruleneed, *rulefound;
+static unsigned long *rulestamp, rulestampnow;
+static unsigned int *rulematched, nrulematched;
+static unsigned int *ruleany, nruleany; /* without patterns */
 /*}}}*/
 /* Compile time check on tags and frame sizes. {{{*/
 struct NumTags {char taglimitexceeded[NTAGS > 31 ? -1 : 1]; 
@@ -354,38 +724,40 @@ void testclear(void)
 void applyrules(Client *c)
 {
 	const char *class, *instance;
-	unsigned int i;
+	char *res_class = NULL, *res_name = NULL;
+	unsigned int i, n;
 	int tagwasset = 0;
 	const Rule *r;
 	Monitor *m;
-	XClassHint ch = { NULL, NULL };
 
 	/* rule matching */
-	XGetClassHint(dpy, c->win, &ch);
-	class    = ch.res_class ? ch.res_class : broken;
-	instance = ch.res_name  ? ch.res_name  : broken;
-
-	for (i = 0; i < LENGTH(rules); i++) {
-		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
-		{
-			if (r->isfloating)
-				c->isfloating = 1;
-			if (r->tag >= 0 && r->tag  < NTAGS) {
-				tagwasset = 1;
-				c->tag = r->tag;
-			}
-			for (m = mons; m && m->num != r->monitor; m = m->next);
-			if (m)
-				c->mon = m;
+	getclasshint(c->win, &res_class, &res_name);
+	class    = res_class ? res_class : broken;
+	instance = res_name  ? res_name  : broken;
+
+	n = matchrules(class, instance, c->name->s);
+	for (i = 0; i < n; i++) {
+		r = &rules[rulematched[i]];
+		if (r->title)
+			c->cold->titlerule = rulematched[i] + 1;
+		if (r->isfloating)
+			c->isfloating = 1;
+		if (r->hide)
+			c->hide = r->hide;
+		if (r->tag >= 0 && r->tag  < NTAGS) {
+			tagwasset = 1;
+			c->tag = r->tag;
 		}
+		for (m = mons; m && m->num != r->monitor; m = m->next);
+		if (m)
+			c->mon = m;
+	}
+	if (retitlerules) {
+		c->cold->class = titleget(class);
+		c->cold->instance = titleget(instance);
 	}
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
+	free(res_class);
+	free(res_name);
 	if (!tagwasset)
 		c->tag = (c->mon->frames + c->mon->selfrm)->tag;
 }/*}}}*/
@@ -423,34 +795,34 @@ int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 		*w = bh;
 	if (resizehints || isfloating(c)) {
 		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		baseismin = c->cold->basew == c->cold->minw && c->cold->baseh == c->cold->minh;
 		if (!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold->basew;
+			*h -= c->cold->baseh;
 		}
 		/* adjust for aspect limits */
-		if (c->mina > 0 && c->maxa > 0) {
-			if (c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if (c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
+		if (c->cold->mina > 0 && c->cold->maxa > 0) {
+			if (c->cold->maxa < (float)*w / *h)
+				*w = *h * c->cold->maxa + 0.5;
+			else if (c->cold->mina < (float)*h / *w)
+				*h = *w * c->cold->mina + 0.5;
 		}
 		if (baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold->basew;
+			*h -= c->cold->baseh;
 		}
 		/* adjust for increment value */
-		if (c->incw)
-			*w -= *w % c->incw;
-		if (c->inch)
-			*h -= *h % c->inch;
+		if (c->cold->incw)
+			*w -= *w % c->cold->incw;
+		if (c->cold->inch)
+			*h -= *h % c->cold->inch;
 		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if (c->maxw)
-			*w = MIN(*w, c->maxw);
-		if (c->maxh)
-			*h = MIN(*h, c->maxh);
+		*w = MAX(*w + c->cold->basew, c->cold->minw);
+		*h = MAX(*h + c->cold->baseh, c->cold->minh);
+		if (c->cold->maxw)
+			*w = MIN(*w, c->cold->maxw);
+		if (c->cold->maxh)
+			*h = MIN(*h, c->cold->maxh);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }/*}}}*/
@@ -458,14 +830,11 @@ int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 void arrange(Monitor *m)
 {
 	if (m) {
-		showhide(m->stack);
-		arrangemon(m);
-		restack(m);
+		m->dirty |= DirtyArrange|DirtyRestack|DirtyBar;
+		discardbatched(EnterNotify); /* restack would have dropped them */
 	} else {
 		for (m = mons; m; m = m->next)
-			showhide(m->stack);
-		for (m = mons; m; m = m->next)
-			arrangemon(m);
+			m->dirty |= DirtyArrange;
 	}
 }/*}}}*/
 /* arrangemon() {{{*/
@@ -491,6 +860,7 @@ void attach(Client *c)
 		return;
 	c->next = c->mon->clients;
 	c->mon->clients = c;
+	tagattach(c);
 }/*}}}*/
 /* attachfocus() {{{*/
 void attachfocus(Client * c)
@@ -503,7 +873,7 @@ void attachfocus(Client * c)
 		c->focusto = 0;
 		return;
 	}
-	add = ecalloc(1, sizeof(ClientLink));
+	add = poolget(&pools[PoolLink]);
 	add->c = c;
 	add->next = c->focusto->focusfrom;
 	add->prev = 0;
@@ -523,6 +893,7 @@ void attachstack(Client *c)
 	else
 		c->mon->stacklast = c;
 	c->mon->stack = c;
+	tagstackattach(c);
 }/*}}}*/
 /* buttonpress() {{{*/
 void buttonpress(XEvent *e)
@@ -558,6 +929,7 @@ void buttonpress(XEvent *e)
 	} else if ((c = wintoclient(ev->window))) {
 		focusclient(c);
 		restack(selmon);
+		commit(); /* focus and raise before the click is replayed */
 		XAllowEvents(dpy, ReplayPointer, CurrentTime);
 		click = ClkClientWin;
 	} else {
@@ -571,11 +943,55 @@ void buttonpress(XEvent *e)
 	for (i = 0; i < LENGTH(buttons); i++)
 		if (click == buttons[i].click && buttons[i].func
 			&& buttons[i].button == ev->button
-			&& CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
+			&& CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state)) {
+			METRIC_BEGIN(b);
 			buttons[i].func(
 				(click == ClkTagBar || click == ClkFrmBar || ClkFrm)
 					&& buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
+			METRIC_END(buttonmetrics + i, b);
+		}
+}/*}}}*/
+/* canceltimer() {{{*/
+void canceltimer(Timer *t)
+{
+	Timer **tp;
+
+	if (!t || !t->armed)
+		return;
+	for (tp = &timers; *tp && *tp != t; tp = &(*tp)->next);
+	if (*tp)
+		*tp = t->next;
+	t->armed = 0;
 }/*}}}*/
+#ifdef CHECKFRMS
+/* checkfrms() {{{*/
+/* compares the frames tracked in each client with the frames */
+void checkfrms(void)
+{
+	unsigned int i, frms, n[NTAGS + 1], urg[NTAGS + 1];
+	Client *c;
+	Monitor *m;
+
+	for (m = mons; m; m = m->next) {
+		memset(n, 0, sizeof n);
+		memset(urg, 0, sizeof urg);
+		for (c = m->clients; c; c = c->next) {
+			for (frms = 0, i = 0; i < NFRAMES; i++)
+				if (m->frames[i].last == c)
+					frms |= 1U << i;
+			if (c->frms != frms)
+				die("staticdwm: frames of 0x%lx tracked as %x, shown in %x",
+					c->win, c->frms, frms);
+			n[TAGLIST(c)]++;
+			urg[TAGLIST(c)] += c->isurgent;
+		}
+		for (i = 0; i <= NTAGS; i++)
+			if (m->ntag[i] != n[i] || m->nurgent[i] != urg[i])
+				die("staticdwm: list %u counted as %u/%u, holds %u/%u", i,
+					m->ntag[i], m->nurgent[i], n[i], urg[i]);
+	}
+}/*}}}*/
+#endif /* CHECKFRMS */
 /* checkoverwm() {{{*/
 void checkotherwm(void)
 {
@@ -590,14 +1006,32 @@ void checkotherwm(void)
 void cleanup(void)
 {
 	Arg a = {.ui = ~0};
+	Client *c;
 	Monitor *m;
 	size_t i;
 
+#ifdef RECORD
+	if (reclog) /* the session ends here */
+		fclose(reclog);
+	reclog = NULL;
+	free(recfrom);
+	free(recto);
+#endif /* RECORD */
 	view(&a);
 	for (m = mons; m; m = m->next)
-		while (m->stack)
-			unmanage(m->stack, 0);
+		while ((c = m->stack)) {
+			if (c->hidden == HideUnmap) { /* so scan() adopts it again */
+				XMapWindow(dpy, c->win);
+				c->hidden = 0;
+				setnetstate(c);
+			}
+			unmanage(c, 0);
+		}
+	commit();
 	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	free(keytab);
+	free(keygrabs);
+	freerules();
 	while (mons)
 		cleanupmon(mons);
 	for (i = 0; i < CurLast; i++)
@@ -606,6 +1040,16 @@ void cleanup(void)
 		free(scheme[i]);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
+	free(wintab);
+	free(clientwins);
+#ifdef METRICS
+	printstats(); /* the counters of the whole session, SIGUSR1 otherwise */
+	writemetrics(NULL);
+#endif /* METRICS */
+	for (i = 0; i < PoolLast; i++)
+		poolclear(&pools[i]);
+	close(sigpipe[0]);
+	close(sigpipe[1]);
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
@@ -621,9 +1065,10 @@ void cleanupmon(Monitor *mon)
 		for (m = mons; m && m->next != mon; m = m->next);
 		m->next = mon->next;
 	}
+	unindexwin(mon->barwin);
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
-	free(mon->frames);
+	free(mon->stacked);
 	free(mon);
 }/*}}}*/
 /* clicktoframe() {{{*/
@@ -662,6 +1107,204 @@ void clientmessage(XEvent *e)
 			seturgent(c, 1);
 	}
 }/*}}}*/
+/* coalesceevents() {{{*/
+/* Walks the batch backwards and drops events superseded later in the batch:
+ * all but the last PropertyNotify per window and atom, all but the last Expose
+ * per bar and all but the last ConfigureRequest per window, which absorbs the
+ * fields of the requests it replaces. Configure requests are not merged across
+ * a map, unmap or destroy of their window. Dropped events get type 0, which
+ * has no handler. */
+void coalesceevents(void)
+{
+	int i;
+	unsigned int h, mask, n;
+	long bit;
+	EvKey k;
+	XEvent *ev;
+	XConfigureRequestEvent *cr, *to;
+
+	if (nevbatch < 2)
+		return;
+	for (n = 4; n < 2 * nevbatch; n <<= 1);
+	mask = n - 1;
+	memset(evkeys, 0, n * sizeof(EvKey));
+	for (i = nevbatch - 1; i >= 0; i--) {
+		ev = evbatch + i;
+		k.type = ev->type;
+		k.atom = None;
+		switch (ev->type) {
+		case PropertyNotify:
+			k.win = ev->xproperty.window;
+			k.atom = ev->xproperty.atom;
+			break;
+		case Expose:
+			k.win = ev->xexpose.window;
+			break;
+		case ConfigureRequest:
+			k.win = ev->xconfigurerequest.window;
+			break;
+		case MapRequest:
+		case UnmapNotify:
+		case DestroyNotify:
+			k.type = ConfigureRequest; /* barrier for configure merging */
+			k.win = ev->type == MapRequest ? ev->xmaprequest.window
+				: ev->type == UnmapNotify ? ev->xunmap.window
+				: ev->xdestroywindow.window;
+			break;
+		default:
+			continue;
+		}
+		h = ((unsigned int)k.win * 31U + (unsigned int)k.atom * 7U
+				+ (unsigned int)k.type) & mask;
+		for (; evkeys[h].type && (evkeys[h].type != k.type
+				|| evkeys[h].win != k.win || evkeys[h].atom != k.atom);
+				h = (h + 1) & mask);
+		if (ev->type != k.type) { /* barrier */
+			if (evkeys[h].type)
+				evkeys[h].idx = -1;
+			continue;
+		}
+		if (!evkeys[h].type || evkeys[h].idx < 0) {
+			evkeys[h] = k;
+			evkeys[h].idx = i;
+			if (ev->type == Expose)
+				ev->xexpose.count = 0; /* last one redraws */
+			continue;
+		}
+		if (ev->type == ConfigureRequest) {
+			cr = &ev->xconfigurerequest;
+			to = &evbatch[evkeys[h].idx].xconfigurerequest;
+			for (bit = 1; bit <= CWStackMode; bit <<= 1) {
+				if (!(cr->value_mask & bit) || (to->value_mask & bit))
+					continue;
+				switch (bit) {
+				case CWX: to->x = cr->x; break;
+				case CWY: to->y = cr->y; break;
+				case CWWidth: to->width = cr->width; break;
+				case CWHeight: to->height = cr->height; break;
+				case CWBorderWidth: to->border_width = cr->border_width; break;
+				case CWSibling: to->above = cr->above; break;
+				case CWStackMode: to->detail = cr->detail; break;
+				}
+				to->value_mask |= bit;
+			}
+		}
+		evstats.coalesced[ev->type]++;
+		ev->type = 0;
+	}
+}/*}}}*/
+/* commit() {{{*/
+/* Does the work arrange(), restack(), refocus() and drawbar() only mark,
+ * once per monitor, in the order the direct calls used to run it. */
+void commit(void)
+{
+	Client *c;
+	Monitor *m;
+
+#ifdef CHECKFRMS
+	checkfrms();
+#endif /* CHECKFRMS */
+	if (nstaletitles)
+		fetchtitles();
+	for (m = mons; m; m = m->next)
+		if (m->dirty & DirtyArrange) {
+			METRIC_BEGIN(a);
+			arrangemon(m); /* sizes only what showhide() shows next */
+			showhide(m);
+			METRIC_END(stepmetrics + MetArrange, a);
+		}
+	for (m = mons; m; m = m->next)
+		if (m->dirty & (DirtyArrange|DirtyRestack)) {
+			METRIC_BEGIN(r);
+			restackmon(m);
+			METRIC_END(stepmetrics + MetRestack, r);
+		}
+	for (m = mons; m; m = m->next)
+		if (m->dirty & (DirtyArrange|DirtyRestack))
+			listsdirty |= ListStacking;
+	if (listsdirty)
+		updateclientlist();
+	if (focusdirty == FocusRefocus && (c = FOCUSED(selmon))) {
+		grabbuttons(c, 1);
+		SETBORDERCOL(c);
+		setfocus(c);
+	} else if (focusdirty != FocusClean) {
+		/* focuses the bar instead of actually focusing nothing */
+		XSetInputFocus(dpy, selmon->barwin, RevertToPointerRoot, CurrentTime);
+		XChangeProperty(dpy, root, netatom[NetActiveWindow],
+			XA_WINDOW, 32, PropModeReplace,
+			(unsigned char *) &(selmon->barwin), 1);
+		/* this is what was replaced from dwm */
+		/* XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
+		XDeleteProperty(dpy, root, netatom[NetActiveWindow]); */
+	}
+	focusdirty = FocusClean;
+	for (m = mons; m; m = m->next) {
+		if (m->dirty & DirtyBar) {
+			METRIC_BEGIN(d);
+			paintbar(m);
+			METRIC_END(stepmetrics + MetDrawbar, d);
+		}
+		m->dirty = 0;
+	}
+}/*}}}*/
+/* compilerules() {{{*/
+/* builds the automaton of each field of the nr rules r, rules[] but in
+ * stubbench, so matchrules() takes time in the length of the names, not in
+ * the number of rules */
+void compilerules(const Rule *r, unsigned int nr)
+{
+	unsigned int f, i, n, s, c, t, head, tail, *queue;
+	const char *p;
+	RuleNode *nodes;
+
+	freerules();
+	ruleneed = ecalloc(nr, sizeof *ruleneed);
+	rulefound = ecalloc(nr, sizeof *rulefound);
+	rulestamp = ecalloc(nr, sizeof *rulestamp);
+	rulematched = ecalloc(nr, sizeof *rulematched);
+	ruleany = ecalloc(nr, sizeof *ruleany);
+	for (f = 0; f < RuleLast; f++) {
+		rulechain[f] = ecalloc(nr, sizeof *rulechain[f]);
+		for (n = 1, i = 0; i < nr; i++) /* a state per byte */
+			if ((p = rulefield(r + i, f)))
+				n += strlen(p);
+		nodes = rulenodes[f] = ecalloc(n, sizeof(RuleNode));
+		for (n = 1, i = 0; i < nr; i++) {
+			if (!(p = rulefield(r + i, f)))
+				continue;
+			ruleneed[i] |= 1 << f;
+			for (s = 0; *p; s = c, p++)
+				if (!(c = rulestep(nodes, s, *p))) {
+					c = n++;
+					nodes[c].c = *p;
+					nodes[c].sibling = nodes[s].child;
+					nodes[s].child = c;
+				}
+			rulechain[f][i] = nodes[s].hit;
+			nodes[s].hit = i + 1;
+		}
+		/* fail and dict states, breadth first so those of shorter
+		 * prefixes are known, the root's children keep failing to it */
+		queue = ecalloc(n, sizeof *queue);
+		head = tail = 0;
+		for (c = nodes[0].child; c; c = nodes[c].sibling)
+			queue[tail++] = c;
+		while (head < tail)
+			for (s = queue[head++], c = nodes[s].child; c; c = nodes[c].sibling) {
+				queue[tail++] = c;
+				for (t = nodes[s].fail; !rulestep(nodes, t, nodes[c].c) && t;
+					t = nodes[t].fail);
+				nodes[c].fail = rulestep(nodes, t, nodes[c].c);
+				t = nodes[c].fail;
+				nodes[c].dict = t && nodes[t].hit ? t : nodes[t].dict;
+			}
+		free(queue);
+	}
+	for (i = 0; i < nr; i++)
+		if (!ruleneed[i])
+			ruleany[nruleany++] = i;
+}/*}}}*/
 /* configure() {{{*/
 void configure(Client *c)
 {
@@ -733,7 +1376,7 @@ void configurerequest(XEvent *e)
 					&& !(ev->value_mask & (CWWidth|CWHeight)))
 				configure(c);
 			if (isinfrm(c))
-				XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+				placeclient(c, c->x, c->y);
 		} else
 			configure(c);
 	} else {
@@ -746,7 +1389,6 @@ void configurerequest(XEvent *e)
 		wc.stack_mode = ev->detail;
 		XConfigureWindow(dpy, ev->window, ev->value_mask, &wc);
 	}
-	XSync(dpy, False);
 }/*}}}*/
 /* createmon() {{{*/
 Monitor * createmon(void)
@@ -788,6 +1430,7 @@ void detach(Client *c)
 		return;
 	for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
 	*tc = c->next;
+	tagdetach(c);
 }/*}}}*/
 /* detachstack() {{{*/
 void detachstack(Client *c)
@@ -802,6 +1445,7 @@ void detachstack(Client *c)
 		c->sprev->snext = c->snext;
 	else
 		c->mon->stack = c->snext;
+	tagstackdetach(c);
 }/*}}}*/
 /* dirtomon() {{{*/
 Monitor * dirtomon(int dir)
@@ -817,14 +1461,74 @@ Monitor * dirtomon(int dir)
 		for (m = mons; m->next != selmon; m = m->next);
 	return m;
 }/*}}}*/
+/* discardbatched() {{{*/
+/* drops not yet dispatched events of a type, for callers that flush the
+ * event queue, so events already pulled into the batch go as well */
+void discardbatched(int type)
+{
+	unsigned int i;
+
+	for (i = evbatchpos + 1; i < nevbatch; i++)
+		if (evbatch[i].type == type)
+			evbatch[i].type = 0;
+}/*}}}*/
+/* dispatch() {{{*/
+void dispatch(XEvent *ev)
+{
+	if (!handler[ev->type])
+		return;
+#ifdef RECORD
+	recevent(ev);
+#endif /* RECORD */
+	METRIC_BEGIN(h);
+#ifdef METRICS
+	if (ev->type == KeyPress || ev->type == ButtonPress) {
+		/* timed to the flush ending the batch, see run() */
+		inputus = inputstart(ev->type == KeyPress ? ev->xkey.time
+			: ev->xbutton.time);
+		inputrq = hrq;
+	}
+#endif /* METRICS */
+	handler[ev->type](ev); /* call handler */
+	METRIC_END(evmetrics + ev->type, h);
+}/*}}}*/
+/* drainevents() {{{*/
+/* Blocks for the next event and pulls everything already pending into the
+ * batch. Key and button presses end the batch, since their handlers may read
+ * the following events straight from the queue (see movemouse()). With
+ * inputfirst, an input event hoistinput() finds is a batch of its own. */
+void drainevents(void)
+{
+	XEvent *ev;
+
+	nevbatch = 0;
+	if (inputfirst && hoistinput(evbatch))
+		nevbatch = 1;
+	else do {
+		ev = evbatch + nevbatch++;
+		XNextEvent(dpy, ev);
+	} while (ev->type != KeyPress && ev->type != ButtonPress
+			&& nevbatch < EVBATCH && XPending(dpy));
+	evstats.batches++;
+	evstats.events += nevbatch;
+}/*}}}*/
 /* drawbar() {{{*/
 void drawbar(Monitor *m)
+{
+	m->dirty |= DirtyBar;
+}/*}}}*/
+/* drawbars() {{{*/
+void drawbars(void)
+{
+	Monitor *m;
+
+	for (m = mons; m; m = m->next)
+		m->dirty |= DirtyBar;
+}/*}}}*/
+/* paintbar() {{{*/
+void paintbar(Monitor *m)
 {
 	int x, w, sw = 0, i;
-	unsigned int urg[NTAGS];
-	unsigned int nclients[NTAGS];
-	unsigned int furg = 0, fclients = 0;
-	
 	char buf[256];
 	Client *c;
 	Frame * fr = m->frames + m->selfrm;
@@ -849,38 +1553,25 @@ void drawbar(Monitor *m)
 		sw = TEXTW(stext) - lrpad + 2; /* 2px right padding */
 		drw_text(drw, m->ww - sw, 0, sw, bh, 0, stext, 0);
 	}
-	for (i = 0; i < NTAGS; i++)
-		urg[i] = nclients[i] = 0;
-	for (c = m->clients; c; c = c->next) {
-		if (c->isfloating) {
-			fclients++;
-			if (c->isurgent)
-				furg = 1;
-		} else if (c->tag >= 0 && c->tag < NTAGS) {
-			nclients[c->tag]++;
-			if (c->isurgent)
-				urg[c->tag] = 1;
-		}
-	}
 	x = 0;
 	/* draw tags */
 	for (i = 0; i < NTAGS; i++) {
-		snprintf(buf, sizeof buf, "%d", nclients[i]);
+		snprintf(buf, sizeof buf, "%u", m->ntag[i]);
 
 		w = TEXTW(buf);
 		drw_setscheme(drw,(m->focfrm && foctag == i) ? sfoc :
 						  ((m->selfrm && seltag == i) ? ssel : snorm));
 		drw_text(drw, x, 0, w, bh, lrpad/2, buf, 0);
-		if (urg[i])
+		if (m->nurgent[i])
 			drw_rect(drw, x + 1, 1, w-2, bh-2, 0, 0);
 		m->btagx[i] = (x += w);
 	}
 	/* draw frame information */
-	snprintf(buf, sizeof buf, "[%d]", fclients);
+	snprintf(buf, sizeof buf, "[%u]", m->ntag[NTAGS]);
 	w = TEXTW(buf) - lrpad;
 	drw_setscheme(drw, 0 == m->focfrm ? sfoc :(0 == m->selfrm ? ssel : snorm));
-	m->bfrmx[0] = x = drw_text(drw, x, 0, w, bh, 0, buf, furg);
-	if (furg)
+	m->bfrmx[0] = x = drw_text(drw, x, 0, w, bh, 0, buf, !!m->nurgent[NTAGS]);
+	if (m->nurgent[NTAGS])
 		drw_rect(drw, x - w + 1, 1, w-2, bh-2, 0, 0);
 	for (i = 1; i < NFRAMES; i++) {
 		c = m->frames[i].last;
@@ -900,9 +1591,9 @@ void drawbar(Monitor *m)
 	/* draw title */
 	if (m->ww - sw - x > bh) {
 		if (m->focfrm != m->selfrm && (c = SELECTED(m))) {
-			char shortname[17];
+			char shortname[SELTITLELEN + 1] = "";
 
-			strncpy(shortname, c->name, (sizeof shortname) - 1);
+			strncpy(shortname, c->name->s, (sizeof shortname) - 1);
 			w = TEXTW(shortname);
 			drw_setscheme(drw, m == selmon ? ssel : snorm);
 			m->bseltitlex = drw_text(drw, x, 0, w, bh, lrpad/2,shortname,0);
@@ -912,22 +1603,16 @@ void drawbar(Monitor *m)
 		w = m->ww - sw - x;
 		if ((c = FOCUSED(m))) {
 			drw_setscheme(drw, m == selmon ? sfoc : snorm);
-			drw_text(drw, x, 0, w, bh, lrpad / 2, c->name, 0);
+			drw_text(drw, x, 0, w, bh, lrpad / 2, c->name->s, 0);
+			m->bfoctitlelen = titleshown(c->name->s, w - lrpad / 2);
 		} else {
 			drw_setscheme(drw, snorm);
 			drw_rect(drw, x, 0, w, bh, 1, 1);
 		}
-	}
+	} else
+		m->bfoctitlelen = 0;
 	drw_map(drw, m->barwin, 0, 0, m->ww, bh);
 }/*}}}*/
-/* drawbars() {{{*/
-void drawbars(void)
-{
-	Monitor *m;
-
-	for (m = mons; m; m = m->next)
-		drawbar(m);
-}/*}}}*/
 /* enternotify() {{{*/
 void enternotify(XEvent *e)
 {
@@ -948,6 +1633,23 @@ void enternotify(XEvent *e)
 		return;
 	}
 }/*}}}*/
+/* evwindow() {{{*/
+/* the window an event is about, rather than the one it was reported to */
+Window evwindow(XEvent *ev)
+{
+	switch (ev->type) {
+	case ConfigureNotify: return ev->xconfigure.window;
+	case ConfigureRequest: return ev->xconfigurerequest.window;
+	case CreateNotify: return ev->xcreatewindow.window;
+	case DestroyNotify: return ev->xdestroywindow.window;
+	case MapNotify: return ev->xmap.window;
+	case MapRequest: return ev->xmaprequest.window;
+	case MappingNotify: return None;
+	case ReparentNotify: return ev->xreparent.window;
+	case UnmapNotify: return ev->xunmap.window;
+	default: return ev->xany.window;
+	}
+}/*}}}*/
 /* exchangeframecontents() {{{*/
 void exchangeframecontents(unsigned int a, unsigned int b)
 {
@@ -961,8 +1663,8 @@ void exchangeframecontents(unsigned int a, unsigned int b)
 	setfocfrm(selmon, (a == selmon->focfrm ? b :
 				(b == selmon->focfrm ? a : selmon->focfrm)));
 	c = fr[a].last;
-	fr[a].last = fr[b].last;
-	fr[b].last = c;
+	setlast(selmon, a, fr[b].last);
+	setlast(selmon, b, c);
 	i = fr[a].tag;
 	fr[a].tag = fr[b].tag;
 	fr[b].tag = i;
@@ -976,29 +1678,85 @@ void expose(XEvent *e)
 	if (ev->count == 0 && (m = wintomon(ev->window)))
 		drawbar(m);
 }/*}}}*/
+/* fetchtitle() {{{*/
+void fetchtitle(Client *c)
+{
+	Monitor *m = c->mon;
+	Title *old;
+
+	c->titlestale = 0;
+	nstaletitles--;
+	if ((old = updatetitle(c)) != c->name) {
+		if (retitlerules)
+			retitle(c);
+		/* the bar shows the start of the focused and the selected title */
+		if ((c == FOCUSED(m) && (!m->bfoctitlelen
+		|| strncmp(old->s, c->name->s, m->bfoctitlelen)))
+		|| (c == SELECTED(m) && m->selfrm != m->focfrm
+		&& strncmp(old->s, c->name->s, SELTITLELEN)))
+			drawbar(m);
+	}
+	titleput(old);
+}/*}}}*/
+/* fetchtitles() {{{*/
+/* Fetches the stale titles of the clients the frames of each monitor show, or
+ * of all its clients with retitlerules, at most every titleinterval ms. The
+ * others are fetched once a frame shows them. */
+void fetchtitles(void)
+{
+	long long now = nowms();
+	unsigned int i, n;
+	int due;
+	Client *c;
+	Monitor *m;
+
+	for (m = mons; m; m = m->next) {
+		n = 0;
+		if (retitlerules)
+			for (c = m->clients; c; c = c->next)
+				n += c->titlestale;
+		else
+			for (i = 0; i <= m->nopenfrms; i++)
+				n += (c = m->frames[i].last) && c->titlestale;
+		if (!n)
+			continue;
+		due = m->titlesdue <= now;
+		RECDATA(&due, sizeof due); /* replays fetch in the same commits */
+		if (!due) {
+			if (!titletimer.armed || titletimer.due > m->titlesdue)
+				settimer(&titletimer, m->titlesdue - now);
+			continue;
+		}
+		m->titlesdue = now + titleinterval;
+		if (retitlerules) {
+			for (c = m->clients; c; c = c->next)
+				if (c->titlestale)
+					fetchtitle(c);
+		} else
+			for (i = 0; i <= m->nopenfrms; i++)
+				if ((c = m->frames[i].last) && c->titlestale)
+					fetchtitle(c);
+	}
+}/*}}}*/
 /* focusclient() {{{*/
 void focusclient(Client *c)
 {
 /* should this be focusing the already focused client? */
 	int i;
+	unsigned int f;
 
 	if (c) {
-		Frame * fr = c->mon->frames;
-
 		unfocus(FOCUSED(selmon), 0);
 		if (isfloating(c)) {
 			selmon = c->mon;
 			setselfrm(selmon, 0);
 			setfocfrm(selmon, 0);
-			FOCUSED(selmon) = c;
-		} else {
-			for (i = 1; i <= c->mon->nopenfrms && c != fr[i].last; i++);
-			if (i <= c->mon->nopenfrms) {
-				selmon = c->mon;
-				setfocfrm(selmon, i);
-				setselfrm(selmon, i);
-				FOCUSED(selmon) = c;
-			}
+			setlast(selmon, 0, c);
+		} else if ((f = c->frms & OPENFRMS(c->mon))) {
+			for (i = 1; !(f & 1U << i); i++);
+			selmon = c->mon;
+			setfocfrm(selmon, i);
+			setselfrm(selmon, i);
 		}
 	}
 	if (FOCUSED(selmon))
@@ -1020,83 +1778,374 @@ void focusin(XEvent *e)
 /* focusnothing() {{{*/
 void focusnothing()
 {
-	/* focuses the bar instead of actually focusing nothing */
-	XSetInputFocus(dpy, selmon->barwin, RevertToPointerRoot, CurrentTime);
-	XChangeProperty(dpy, root, netatom[NetActiveWindow],
-		XA_WINDOW, 32, PropModeReplace,
-		(unsigned char *) &(selmon->barwin), 1);
-	/* this is what was replaced from dwm */
-	/* XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-	XDeleteProperty(dpy, root, netatom[NetActiveWindow]); */
+	focusdirty = FocusNothing; /* commit() focuses the bar */
+}/*}}}*/
+/* freerules() {{{*/
+void freerules(void)
+{
+	unsigned int f;
+
+	for (f = 0; f < RuleLast; f++) {
+		free(rulenodes[f]);
+		free(rulechain[f]);
+		rulenodes[f] = NULL;
+		rulechain[f] = NULL;
+	}
+	free(ruleneed);
+	free(rulefound);
+	free(rulestamp);
+	free(rulematched);
+	free(ruleany);
+	ruleneed = rulefound = NULL;
+	rulestamp = NULL;
+	rulematched = ruleany = NULL;
+	nruleany = nrulematched = 0;
 }/*}}}*/
 /* getatomprop {{{*/
 Atom getatomprop(Client *c, Atom prop)
 {
+	Atom atom = None;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+
+	if ((r = getprop(c->win, prop, sizeof atom))) {
+		if (r->type == XA_ATOM && r->format == 32 && r->value_len)
+			atom = *(xcb_atom_t *)xcb_get_property_value(r);
+		free(r);
+	}
+#else
 	int di;
 	unsigned long dl;
 	unsigned char *p = NULL;
-	Atom da, atom = None;
+	Atom da;
 
 	if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, XA_ATOM,
 		&da, &di, &dl, &dl, &p) == Success && p) {
 		atom = *(Atom *)p;
 		XFree(p);
 	}
+#endif /* XCB */
+	RECDATA(&atom, sizeof atom);
 	return atom;
 }/*}}}*/
+/* getattributes() {{{*/
+/* the XWindowAttributes members manage() and scan() use */
+int getattributes(Window w, XWindowAttributes *wa)
+{
+	int ok;
+#ifdef XCB
+	xcb_get_window_attributes_cookie_t ac;
+	xcb_get_geometry_cookie_t gc;
+	xcb_get_window_attributes_reply_t *a;
+	xcb_get_geometry_reply_t *g;
+
+	if (curpf && curpf->win == w && !curpf->attrsresolved) {
+		curpf->attrsresolved = 1;
+		ac = curpf->attrs;
+		gc = curpf->geom;
+	} else {
+		ac = xcb_get_window_attributes(xcon, w);
+		gc = xcb_get_geometry(xcon, w);
+	}
+	a = xcb_get_window_attributes_reply(xcon, ac, NULL);
+	g = xcb_get_geometry_reply(xcon, gc, NULL);
+	if ((ok = a && g)) {
+		wa->x = g->x;
+		wa->y = g->y;
+		wa->width = g->width;
+		wa->height = g->height;
+		wa->border_width = g->border_width;
+		wa->map_state = a->map_state;
+		wa->override_redirect = a->override_redirect;
+	}
+	free(a);
+	free(g);
+#else
+	ok = XGetWindowAttributes(dpy, w, wa);
+#endif /* XCB */
+	RECDATA(&ok, sizeof ok);
+	RECDATA(wa, sizeof *wa);
+	return ok;
+}/*}}}*/
+/* getclasshint() {{{*/
+/* instance and class of WM_CLASS, to be freed with free() */
+int getclasshint(Window w, char **class, char **instance)
+{
+	int ok = 0;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+	char *v;
+	int len, n;
+
+	if ((r = getprop(w, XA_WM_CLASS, 1024)) && r->type == XA_STRING
+	&& r->format == 8 && (len = xcb_get_property_value_length(r))) {
+		v = xcb_get_property_value(r);
+		n = strnlen(v, len);
+		*instance = ecalloc(1, n + 1);
+		memcpy(*instance, v, n);
+		v += n + 1;
+		len -= MIN(n + 1, len);
+		n = strnlen(v, len);
+		*class = ecalloc(1, n + 1);
+		memcpy(*class, v, n);
+		ok = 1;
+	}
+	free(r);
+#else
+	XClassHint ch = { NULL, NULL };
+
+	if ((ok = XGetClassHint(dpy, w, &ch))) {
+		*class = ch.res_class ? strdup(ch.res_class) : NULL;
+		*instance = ch.res_name ? strdup(ch.res_name) : NULL;
+		if (ch.res_class)
+			XFree(ch.res_class);
+		if (ch.res_name)
+			XFree(ch.res_name);
+	}
+#endif /* XCB */
+	RECDATA(&ok, sizeof ok);
+#ifdef RECORD
+	recstr(class);
+	recstr(instance);
+#endif /* RECORD */
+	return ok;
+}/*}}}*/
+#ifdef XCB
+/* getprop() {{{*/
+/* Reply for len words of prop of w, to be freed with free(). A copy of the
+ * prefetched reply if there is one, requested and waited for otherwise. */
+xcb_get_property_reply_t * getprop(Window w, Atom prop, uint32_t len)
+{
+	int i;
+	size_t n;
+	xcb_get_property_reply_t *r;
+
+	if (curpf && curpf->win == w)
+		for (i = 0; i < PfLast; i++)
+			if (pfatom[i] == prop) {
+				if (!(curpf->resolved & 1 << i)) {
+					curpf->resolved |= 1 << i;
+					curpf->reply[i] = xcb_get_property_reply(xcon,
+						curpf->cookie[i], NULL);
+				}
+				if (!(r = curpf->reply[i]))
+					return NULL;
+				n = sizeof *r + 4 * (size_t)r->length;
+				return memcpy(ecalloc(1, n), r, n);
+			}
+	return xcb_get_property_reply(xcon, xcb_get_property(xcon, 0, w, prop,
+		XCB_GET_PROPERTY_TYPE_ANY, 0, len), NULL);
+}/*}}}*/
+#endif /* XCB */
+/* getprotocols() {{{*/
+/* the WM_PROTOCOLS of w we know, bit per wmatom index */
+unsigned int getprotocols(Window w)
+{
+	unsigned int i, p = 0;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+	xcb_atom_t *v;
+	int n;
+
+	if ((r = getprop(w, wmatom[WMProtocols], 16))
+	&& r->type == XA_ATOM && r->format == 32) {
+		v = xcb_get_property_value(r);
+		for (n = r->value_len; n--; )
+			for (i = 0; i < WMLast; i++)
+				if (v[n] == wmatom[i])
+					p |= 1 << i;
+	}
+	free(r);
+#else
+	Atom *protocols;
+	int n;
+
+	if (XGetWMProtocols(dpy, w, &protocols, &n)) {
+		while (n--)
+			for (i = 0; i < WMLast; i++)
+				if (protocols[n] == wmatom[i])
+					p |= 1 << i;
+		XFree(protocols);
+	}
+#endif /* XCB */
+	RECDATA(&p, sizeof p);
+	return p;
+}/*}}}*/
 /* getrootptr() {{{*/
 int getrootptr(int *x, int *y)
 {
+	int ok;
+#ifdef XCB
+	xcb_query_pointer_reply_t *r;
+
+	if ((ok = !!(r = xcb_query_pointer_reply(xcon,
+			xcb_query_pointer(xcon, root), NULL)))) {
+		*x = r->root_x;
+		*y = r->root_y;
+	}
+	free(r);
+#else
 	int di;
 	unsigned int dui;
 	Window dummy;
 
-	return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
+	ok = XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
+#endif /* XCB */
+	RECDATA(&ok, sizeof ok);
+	RECDATA(x, sizeof *x);
+	RECDATA(y, sizeof *y);
+	return ok;
+}/*}}}*/
+/* getsizehints() {{{*/
+int getsizehints(Window w, XSizeHints *size)
+{
+	int ok = 0;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+	int32_t *v;
+
+	memset(size, 0, sizeof *size);
+	/* the WM_SIZE_HINTS layout XGetWMNormalHints() decodes */
+	if ((r = getprop(w, XA_WM_NORMAL_HINTS, 18)) && r->type == XA_WM_SIZE_HINTS
+	&& r->format == 32 && r->value_len >= 15) {
+		v = xcb_get_property_value(r);
+		size->flags = (uint32_t)v[0];
+		size->x = v[1];
+		size->y = v[2];
+		size->width = v[3];
+		size->height = v[4];
+		size->min_width = v[5];
+		size->min_height = v[6];
+		size->max_width = v[7];
+		size->max_height = v[8];
+		size->width_inc = v[9];
+		size->height_inc = v[10];
+		size->min_aspect.x = v[11];
+		size->min_aspect.y = v[12];
+		size->max_aspect.x = v[13];
+		size->max_aspect.y = v[14];
+		if (r->value_len >= 18) {
+			size->base_width = v[15];
+			size->base_height = v[16];
+			size->win_gravity = v[17];
+		} else {
+			size->base_width = size->base_height = 0;
+			size->flags &= ~(PBaseSize|PWinGravity);
+		}
+		ok = 1;
+	}
+	free(r);
+#else
+	long msize;
+
+	ok = XGetWMNormalHints(dpy, w, size, &msize);
+#endif /* XCB */
+	RECDATA(&ok, sizeof ok);
+	RECDATA(size, sizeof *size);
+	return ok;
 }/*}}}*/
 /* getstate() {{{*/
 long getstate(Window w)
 {
-	int format;
 	long result = -1;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+
+	if ((r = getprop(w, wmatom[WMState], 2L)) && r->type == wmatom[WMState]
+	&& r->format == 32 && r->value_len)
+		result = *(uint32_t *)xcb_get_property_value(r);
+	free(r);
+#else
+	int format;
 	unsigned char *p = NULL;
 	unsigned long n, extra;
 	Atom real;
 
 	if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
-		&real, &format, &n, &extra, (unsigned char **)&p) != Success)
-		return -1;
-	if (n != 0)
-		result = *p;
-	XFree(p);
+		&real, &format, &n, &extra, (unsigned char **)&p) == Success) {
+		if (n != 0)
+			result = *p;
+		XFree(p);
+	}
+#endif /* XCB */
+	RECDATA(&result, sizeof result);
 	return result;
 }/*}}}*/
 /* gettextprop() {{{*/
 int gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
-	char **list = NULL;
-	int n;
-	XTextProperty name;
+	char *s;
 
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	if (!(s = textprop(w, atom)))
 		return 0;
-	if (name.encoding == XA_STRING)
-		strncpy(text, (char *)name.value, size - 1);
-	else {
-		if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
-			strncpy(text, *list, size - 1);
-			XFreeStringList(list);
-		}
-	}
+	strncpy(text, s, size - 1);
 	text[size - 1] = '\0';
-	XFree(name.value);
+	free(s);
 	return 1;
 }/*}}}*/
+/* gettransient() {{{*/
+int gettransient(Window w, Window *trans)
+{
+	int ok;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+
+	if ((ok = (r = getprop(w, XA_WM_TRANSIENT_FOR, 1)) && r->type == XA_WINDOW
+	&& r->format == 32 && r->value_len))
+		*trans = *(xcb_window_t *)xcb_get_property_value(r);
+	free(r);
+#else
+	ok = XGetTransientForHint(dpy, w, trans);
+#endif /* XCB */
+	RECDATA(&ok, sizeof ok);
+	RECDATA(trans, sizeof *trans);
+	return ok;
+}/*}}}*/
+/* getwmhints() {{{*/
+/* returns hints to be freed with XFree() */
+XWMHints * getwmhints(Window w)
+{
+	XWMHints *wmh = NULL;
+#ifdef XCB
+	xcb_get_property_reply_t *r;
+	int32_t *v;
+
+	/* the WM_HINTS layout XGetWMHints() decodes */
+	if ((r = getprop(w, XA_WM_HINTS, 9)) && r->type == XA_WM_HINTS
+	&& r->format == 32 && r->value_len >= 8 && (wmh = XAllocWMHints())) {
+		v = xcb_get_property_value(r);
+		wmh->flags = (uint32_t)v[0];
+		wmh->input = v[1] != 0;
+		wmh->initial_state = v[2];
+		wmh->icon_pixmap = (uint32_t)v[3];
+		wmh->icon_window = (uint32_t)v[4];
+		wmh->icon_x = v[5];
+		wmh->icon_y = v[6];
+		wmh->icon_mask = (uint32_t)v[7];
+		if (r->value_len >= 9)
+			wmh->window_group = (uint32_t)v[8];
+		else
+			wmh->flags &= ~WindowGroupHint;
+	}
+	free(r);
+#else
+	wmh = XGetWMHints(dpy, w);
+#endif /* XCB */
+#ifdef RECORD
+	wmh = recwmhints(wmh);
+#endif /* RECORD */
+	return wmh;
+}/*}}}*/
 /* grabbuttons() {{{*/
+/* regrabs only if the grabs for focused differ from those c has */
 void grabbuttons(Client *c, int focused)
 {
+	if (c->grabbed == (focused ? GrabFocused : GrabUnfocused))
+		return;
+	c->grabbed = focused ? GrabFocused : GrabUnfocused;
 	updatenumlockmask();
 	{
 		unsigned int i, j;
@@ -1115,22 +2164,184 @@ void grabbuttons(Client *c, int focused)
 						GrabModeAsync, GrabModeSync, None, None);
 	}
 }/*}}}*/
+/* grabcmp() {{{*/
+int grabcmp(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}/*}}}*/
 /* grabkeys() {{{*/
+/* Binds every keycode whose first symbol is that of a key to it in keytab and
+ * grabs it. Only the grabs that differ from the previous ones are sent. */
 void grabkeys(void)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		KeyCode code;
+	unsigned int modifiers[] = { 0, LockMask, 0, LockMask }; /* | numlockmask */
+	unsigned int i, j, n = 0, ngrabs = 0, mask;
+	unsigned long *grabs;
+	int min, max, per, code;
+	KeySym *syms;
+	KeySlot *ks;
 
-		XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	updatenumlockmask();
+	modifiers[2] |= numlockmask;
+	modifiers[3] |= numlockmask;
+	XDisplayKeycodes(dpy, &min, &max);
+	if (!(syms = XGetKeyboardMapping(dpy, min, max - min + 1, &per)))
+		per = 0;
+	for (code = min; per && code <= max; code++)
 		for (i = 0; i < LENGTH(keys); i++)
-			if ((code = XKeysymToKeycode(dpy, keys[i].keysym)))
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabKey(dpy, code, keys[i].mod | modifiers[j], root,
-						True, GrabModeAsync, GrabModeAsync);
+			n += syms[(code - min) * per] == keys[i].keysym;
+	free(keytab);
+	for (keytabbits = 4; (1U << keytabbits) < 2 * n; keytabbits++);
+	keytab = ecalloc(1U << keytabbits, sizeof(KeySlot));
+	grabs = ecalloc(n * LENGTH(modifiers) + 1, sizeof *grabs);
+	/* in keys[] order, so bindings of the same keys run in that order */
+	for (i = 0; i < LENGTH(keys); i++)
+		for (code = min; per && code <= max; code++) {
+			if (syms[(code - min) * per] != keys[i].keysym)
+				continue;
+			mask = CLEANMASK(keys[i].mod);
+			for (j = KEYHASH(code, mask); keytab[j].code;
+				j = (j + 1) & ((1U << keytabbits) - 1));
+			ks = keytab + j;
+			ks->code = code;
+			ks->mask = mask;
+			ks->key = i;
+			for (j = 0; j < LENGTH(modifiers); j++)
+				grabs[ngrabs++] = (unsigned long)code << 16
+					| keys[i].mod | modifiers[j];
+		}
+	if (syms)
+		XFree(syms);
+	qsort(grabs, ngrabs, sizeof *grabs, grabcmp);
+	for (i = j = 0; i < ngrabs; i++) /* drop duplicates */
+		if (!j || grabs[j - 1] != grabs[i])
+			grabs[j++] = grabs[i];
+	ngrabs = j;
+	/* both sorted, so one pass finds the grabs to drop and to add */
+	for (i = j = 0; i < nkeygrabs || j < ngrabs; )
+		if (j == ngrabs || (i < nkeygrabs && keygrabs[i] < grabs[j])) {
+			XUngrabKey(dpy, keygrabs[i] >> 16, keygrabs[i] & 0xffff, root);
+			i++;
+		} else if (i == nkeygrabs || grabs[j] < keygrabs[i]) {
+			XGrabKey(dpy, grabs[j] >> 16, grabs[j] & 0xffff, root,
+				True, GrabModeAsync, GrabModeAsync);
+			j++;
+		} else
+			i++, j++;
+	free(keygrabs);
+	keygrabs = grabs;
+	nkeygrabs = ngrabs;
+}/*}}}*/
+/* indexwin() {{{*/
+void indexwin(Window w, Client *c, Monitor *m)
+{
+	unsigned int i, n, mask;
+	WinSlot *old;
+
+	if (!w)
+		return;
+	if (2 * (wintabused + 1) > (1U << wintabbits)) { /* grow, keep load <1/2 */
+		old = wintab;
+		n = wintabbits ? 1U << wintabbits : 0;
+		wintabbits = wintabbits ? wintabbits + 1 : 6;
+		wintab = ecalloc(1U << wintabbits, sizeof(WinSlot));
+		wintabused = 0;
+		for (i = 0; i < n; i++)
+			if (old[i].win)
+				indexwin(old[i].win, old[i].c, old[i].m);
+		free(old);
+	}
+	mask = (1U << wintabbits) - 1;
+	for (i = WINHASH(w); wintab[i].win && wintab[i].win != w; i = (i+1) & mask);
+	if (!wintab[i].win)
+		wintabused++;
+	wintab[i].win = w;
+	wintab[i].c = c;
+	wintab[i].m = m;
+}/*}}}*/
+#ifdef METRICS
+/* inputstart() {{{*/
+/* when, in nowus() time, the server took timestamp t, taking the quickest
+ * delivery seen as instant; server time wrapping around starts over */
+long long inputstart(Time t)
+{
+	static long long offset = LLONG_MIN;
+	long long d = nowus() - (long long)t * 1000;
+
+	if (offset == LLONG_MIN || d < offset || d - offset > 60000000LL)
+		offset = d;
+	return (long long)t * 1000 + offset;
+}/*}}}*/
+#endif /* METRICS */
+/* handlesignals() {{{*/
+/* runs the work of signals the handler passed through sigpipe */
+void handlesignals(void)
+{
+	unsigned char sig[16];
+	ssize_t i, n;
+
+	while ((n = read(sigpipe[0], sig, sizeof sig)) > 0)
+		for (i = 0; i < n; i++)
+			switch (sig[i]) {
+			case SIGCHLD:
+				while (0 < waitpid(-1, NULL, WNOHANG));
+				break;
+			case SIGTERM:
+				running = 0;
+				break;
+			case SIGUSR1:
+				printstats();
+#ifdef METRICS
+				writemetrics(NULL);
+#endif /* METRICS */
+				break;
+			}
+}/*}}}*/
+/* hoistable() {{{*/
+/* XCheckIfEvent() predicate taking the first input event of the queue, as
+ * long as the events ahead of it are only PropertyNotify, ConfigureRequest
+ * and Expose about other windows. Any other event may change what a binding
+ * acts on, the monitor or focus, and holds input back. Keys are reported to
+ * root, whose properties only set the status text, so those never hold a
+ * key back. */
+Bool hoistable(Display *d, XEvent *ev, XPointer arg)
+{
+	Hoist *h = (Hoist *)arg;
+	Window w = evwindow(ev);
+	unsigned int i;
+
+	if (h->blocked)
+		return False;
+	for (i = 0; i < h->nwins && h->wins[i] != w; i++);
+	if (ev->type == KeyPress || ev->type == ButtonPress
+			|| ev->type == MappingNotify) {
+		h->blocked = i < h->nwins;
+		return !h->blocked;
 	}
+	if (ev->type != PropertyNotify && ev->type != ConfigureRequest
+			&& ev->type != Expose)
+		h->blocked = 1;
+	else if (i < h->nwins || w == root)
+		return False;
+	else if (h->nwins == LENGTH(h->wins))
+		h->blocked = 1; /* too many to keep apart */
+	else
+		h->wins[h->nwins++] = w;
+	return False;
+}/*}}}*/
+/* hoistinput() {{{*/
+/* takes the input event hoistable() picks from the queue into ev */
+int hoistinput(XEvent *ev)
+{
+	Hoist h = { .nwins = 0 };
+
+	if (!XCheckIfEvent(dpy, ev, hoistable, (XPointer)&h))
+		return 0;
+	if (h.nwins)
+		evstats.hoisted++;
+	return 1;
 }/*}}}*/
 /* isavailable() {{{*/
 int isavailable(Client * c)
@@ -1153,19 +2364,10 @@ int isfloating(Client * c)
 /* isinfrm() {{{*/
 int isinfrm(Client * c)
 {
-	int i;
-	Frame * fr;
-	
 	if (!c)
 		return 0;
-	if (c->isfloating) /* floating windows */
-		return 1;
-	fr = c->mon->frames;
-	if (c->mon->nopenfrms) /* windows in frames */
-		for (i = 1; i <= c->mon->nopenfrms; i++)
-			if (fr[i].last == c)
-				return 1;
-	return 0;
+	/* floating windows and windows in open frames */
+	return c->isfloating || (c->frms & OPENFRMS(c->mon));
 }/*}}}*/
 /* isuniquegeom() {{{*/
 #ifdef XINERAMA
@@ -1183,17 +2385,55 @@ int isuniquegeom(XineramaScreenInfo *unique, size_t n,
 /* keypress() {{{*/
 void keypress(XEvent *e)
 {
-	unsigned int i;
-	KeySym keysym;
+	unsigned int i, mask;
 	XKeyEvent *ev;
+	const Key *key;
 
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	if (!keytab)
+		return;
+	mask = CLEANMASK(ev->state);
+	for (i = KEYHASH(ev->keycode, mask); keytab[i].code;
+		i = (i + 1) & ((1U << keytabbits) - 1))
+		if (keytab[i].code == ev->keycode && keytab[i].mask == mask
+		&& (key = keys + keytab[i].key)->func) {
+			METRIC_BEGIN(k);
+			RUNKEY(key);
+			METRIC_END(keymetrics + keytab[i].key, k);
+		}
+}/*}}}*/
+/* listclient() {{{*/
+/* adds w to the client lists, published by the next commit() */
+void listclient(Window w)
+{
+	Window *old = clientwins, *oldstack = stackwins;
+
+	if (nclientwins == nclientwinsmax) {
+		nclientwinsmax = nclientwinsmax ? 2 * nclientwinsmax : 64;
+		clientwins = ecalloc(3 * nclientwinsmax, sizeof(Window));
+		stackwins = clientwins + nclientwinsmax;
+		stackwinsnew = stackwins + nclientwinsmax;
+		if (old) {
+			memcpy(clientwins, old, nclientwins * sizeof(Window));
+			memcpy(stackwins, oldstack, nstackwins * sizeof(Window));
+		}
+		free(old);
+	}
+	clientwins[nclientwins++] = w;
+	listsdirty |= ListClients|ListStacking;
+}/*}}}*/
+/* lookupwin() {{{*/
+WinSlot * lookupwin(Window w)
+{
+	unsigned int i, mask;
+
+	if (!wintab || !w)
+		return NULL;
+	mask = (1U << wintabbits) - 1;
+	for (i = WINHASH(w); wintab[i].win; i = (i + 1) & mask)
+		if (wintab[i].win == w)
+			return wintab + i;
+	return NULL;
 }/*}}}*/
 /* consider breaking this into smaller functions */
 /* manage() {{{*/
@@ -1202,8 +2442,10 @@ void manage(Window w, XWindowAttributes *wa)
 	Client *c, *t = NULL;
 	Window trans = None;
 	XWindowChanges wc;
+	METRIC_BEGIN(t);
 
-	c = ecalloc(1, sizeof(Client));
+	c = poolget(&pools[PoolClient]);
+	c->cold = poolget(&pools[PoolCold]);
 	c->win = w;
 	c->isfixed = c->isurgent = c->neverfocus = 0;
 	c->isfloating = c->isfullscreen = 0;
@@ -1211,14 +2453,14 @@ void manage(Window w, XWindowAttributes *wa)
 	c->focusto = 0;
 	c->focusfrom = 0;
 	/* geometry */
-	c->x = c->oldx = wa->x;
-	c->y = c->oldy = wa->y;
-	c->w = c->oldw = wa->width;
-	c->h = c->oldh = wa->height;
-	c->oldbw = wa->border_width;
-
-	updatetitle(c);
-	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+	c->x = c->cold->oldx = wa->x;
+	c->y = c->cold->oldy = wa->y;
+	c->w = c->cold->oldw = wa->width;
+	c->h = c->cold->oldh = wa->height;
+	c->cold->oldbw = wa->border_width;
+
+	titleput(updatetitle(c));
+	if (gettransient(w, &trans) && (t = wintoclient(trans))) {
 		c->mon = t->mon;
 		c->tag = t->tag;
 		c->focusto = t;
@@ -1244,12 +2486,13 @@ void manage(Window w, XWindowAttributes *wa)
 	updatewindowtype(c); /* sets floating, so needs to happen before border */
 	attachfocus(c);
 	c->bw = c->isfloating ? flborderpx : borderpx;
-	wc.border_width = c->bw;
+	wc.border_width = c->abw = c->bw;
 	XConfigureWindow(dpy, w, CWBorderWidth, &wc);
 	XSetWindowBorder(dpy, w, scheme[SchemeNorm][ColBorder].pixel);
 	configure(c); /* propagates border_width, if size doesn't change */
 	updatesizehints(c);
 	updatewmhints(c);
+	c->protocols = getprotocols(w);
 	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask
 							|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
@@ -1257,21 +2500,23 @@ void manage(Window w, XWindowAttributes *wa)
 	if ((t = SELECTED(c->mon))) {
 		c->next = t->next;
 		t->next = c;
+		tagattach(c);
 	} else {
 		attach(c);
 	}
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32,
-					PropModeAppend, (unsigned char *) &(c->win), 1);
+	indexwin(c->win, c, NULL);
+	listclient(c->win);
 	/* some windows require this */
-	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h);
+	XMoveResizeWindow(dpy, c->win, c->ax = c->x + 2 * sw, c->ay = c->y,
+		c->aw = c->w, c->ah = c->h);
 	setclientstate(c, NormalState);
 	XMapWindow(dpy, c->win);
 	if (c->mon == selmon && selmon->selfrm == selmon->focfrm) {
 		unfocus(FOCUSED(selmon), 0);
 	}
 	if (c->isfloating) {
-		SELECTED(c->mon) = selwinforselfrm(c->mon, 0);
+		setlast(c->mon, c->mon->selfrm, selwinforselfrm(c->mon, 0));
 		if (c->mon->selfrm == c->mon->focfrm) {
 			setfocfrm(c->mon, 0);
 			setselfrm(c->mon, 0);
@@ -1279,36 +2524,111 @@ void manage(Window w, XWindowAttributes *wa)
 			setselfrm(c->mon, 0);
 			restack(selmon);
 		}
-		c->mon->frames->last = c;
+		setlast(c->mon, 0, c);
 	} else {
-		SELECTED(c->mon) = c;
+		setlast(c->mon, c->mon->selfrm, c);
 	}
 	if (c->mon == selmon && selmon->selfrm == selmon->focfrm)
 		refocus();
 	arrange(c->mon);
+	METRIC_END(stepmetrics + MetManage, t);
+}/*}}}*/
+/* markurgent() {{{*/
+/* sets c->isurgent, counted in nurgent once c is in a tag list */
+void markurgent(Client *c, int urg)
+{
+	if (c->isurgent == urg)
+		return;
+	c->isurgent = urg;
+	if (c->tprev || c->mon->tagclients[c->tlist] == c) {
+		if (urg)
+			c->mon->nurgent[c->tlist]++;
+		else
+			c->mon->nurgent[c->tlist]--;
+	}
+}/*}}}*/
+/* matchrules() {{{*/
+/* collects the indices of the rules matching, in order, in rulematched */
+unsigned int matchrules(const char *class, const char *instance,
+	const char *title)
+{
+	unsigned int i, j, r;
+
+	rulestampnow++;
+	memcpy(rulematched, ruleany, nruleany * sizeof *rulematched);
+	nrulematched = nruleany;
+	rulescan(RuleClass, class);
+	rulescan(RuleInstance, instance);
+	rulescan(RuleTitle, title);
+	for (i = 1; i < nrulematched; i++) /* few, insertion sorted */
+		for (j = i; j && rulematched[j - 1] > (r = rulematched[j]); j--) {
+			rulematched[j] = rulematched[j - 1];
+			rulematched[j - 1] = r;
+		}
+	return nrulematched;
 }/*}}}*/
 /* mappingnotify() {{{*/
 void mappingnotify(XEvent *e)
 {
 	XMappingEvent *ev = &e->xmapping;
+	unsigned int oldmask = numlockmask;
+	int focused;
+	Client *c;
+	Monitor *m;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
+#ifdef XCB
+	requestmodmap();
+#else
+	modpending = 1;
+#endif /* XCB */
+	if (ev->request == MappingPointer)
+		return;
+	updatenumlockmask();
+	/* the key and button grabs include numlockmask */
+	if (ev->request == MappingKeyboard || numlockmask != oldmask)
 		grabkeys();
+	if (numlockmask == oldmask)
+		return;
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			if (c->grabbed) {
+				focused = c->grabbed == GrabFocused;
+				c->grabbed = GrabNone;
+				grabbuttons(c, focused);
+			}
 }/*}}}*/
 /* maprequest() {{{*/
 void maprequest(XEvent *e)
 {
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	Prefetch pf;
 
-	if (!XGetWindowAttributes(dpy, ev->window, &wa))
-		return;
-	if (wa.override_redirect)
+	if (wintoclient(ev->window))
 		return;
-	if (!wintoclient(ev->window))
+	prefetch(&pf, ev->window);
+	curpf = &pf;
+	if (getattributes(ev->window, &wa) && !wa.override_redirect)
 		manage(ev->window, &wa);
+	pfrelease(&pf);
+}/*}}}*/
+#ifdef METRICS
+/* metricadd() {{{*/
+/* records a call that started at us and before request rq */
+void metricadd(Metric *m, long long us, unsigned long rq)
+{
+	int b = 0;
+
+	us = nowus() - us;
+	while (b < NBUCKETS - 1 && us >> b)
+		b++;
+	m->bucket[b]++;
+	m->n++;
+	m->reqs += NextRequest(dpy) - rq;
+	m->max = MAX(m->max, us);
 }/*}}}*/
+#endif /* METRICS */
 /* moitionnotify() {{{*/
 void motionnotify(XEvent *e)
 {
@@ -1325,6 +2645,174 @@ void motionnotify(XEvent *e)
 	}
 	mon = m;
 }/*}}}*/
+/* nexttimeout() {{{*/
+/* poll() timeout until the next timer is due, -1 sleeps until an event */
+int nexttimeout(void)
+{
+	long long ms;
+
+	if (!timers)
+		return -1;
+	ms = timers->due - nowms();
+	return ms < 0 ? 0 : ms > 0x7fffffff ? 0x7fffffff : (int)ms;
+}/*}}}*/
+/* nowms() {{{*/
+long long nowms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}/*}}}*/
+#ifdef METRICS
+/* nowus() {{{*/
+long long nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}/*}}}*/
+#endif /* METRICS */
+/* printstats() {{{*/
+void printstats(void)
+{
+	long long up = nowms() - loopstats.start;
+	int i;
+
+	fprintf(stderr, "staticdwm: %lu events in %lu batches, coalesced %lu "
+		"PropertyNotify, %lu ConfigureRequest, %lu Expose\n",
+		evstats.events, evstats.batches, evstats.coalesced[PropertyNotify],
+		evstats.coalesced[ConfigureRequest], evstats.coalesced[Expose]);
+	fprintf(stderr, "staticdwm: %lu input events handled ahead of others\n",
+		evstats.hoisted);
+	fprintf(stderr, "staticdwm: %lu wakeups in %lld s, %.3f per second\n",
+		loopstats.wakeups, up / 1000,
+		up > 0 ? loopstats.wakeups * 1000.0 / up : 0.0);
+	for (i = 0; i < PoolLast; i++)
+		fprintf(stderr, "staticdwm: %lu %s objects live, %lu at peak, %lu "
+			"allocated\n", pools[i].live, pools[i].name, pools[i].peak,
+			pools[i].nblocks * POOLBLOCK);
+#ifdef COUNTSYNC
+	fprintf(stderr, "staticdwm: %lu XSync round trips\n", nsyncs);
+#endif /* COUNTSYNC */
+}/*}}}*/
+/* prefetch() {{{*/
+/* sends every request manage() makes for w without waiting for replies */
+void prefetch(Prefetch *pf, Window w)
+{
+#ifdef XCB
+	int i;
+
+	pf->attrs = xcb_get_window_attributes(xcon, w);
+	pf->geom = xcb_get_geometry(xcon, w);
+	for (i = 0; i < PfLast; i++)
+		pf->cookie[i] = xcb_get_property(xcon, 0, w, pfatom[i],
+				XCB_GET_PROPERTY_TYPE_ANY, 0, pflen[i]);
+	pf->resolved = 0;
+	pf->attrsresolved = 0;
+#endif /* XCB */
+	pf->win = w;
+}/*}}}*/
+/* pfrelease() {{{*/
+void pfrelease(Prefetch *pf)
+{
+#ifdef XCB
+	int i;
+
+	if (!pf->attrsresolved) {
+		xcb_discard_reply(xcon, pf->attrs.sequence);
+		xcb_discard_reply(xcon, pf->geom.sequence);
+	}
+	for (i = 0; i < PfLast; i++)
+		if (!(pf->resolved & 1 << i))
+			xcb_discard_reply(xcon, pf->cookie[i].sequence);
+		else
+			free(pf->reply[i]);
+#endif /* XCB */
+	if (curpf == pf)
+		curpf = NULL;
+	pf->win = None;
+}/*}}}*/
+/* placeclient() {{{*/
+/* moves the window of c to x, y with the size and border of c, sending only
+ * what differs from what was sent before; returns the CW mask sent */
+unsigned int placeclient(Client *c, int x, int y)
+{
+	unsigned int mask = 0;
+	XWindowChanges wc;
+
+	if (x != c->ax) {
+		wc.x = c->ax = x;
+		mask |= CWX;
+	}
+	if (y != c->ay) {
+		wc.y = c->ay = y;
+		mask |= CWY;
+	}
+	if (c->w != c->aw) {
+		wc.width = c->aw = c->w;
+		mask |= CWWidth;
+	}
+	if (c->h != c->ah) {
+		wc.height = c->ah = c->h;
+		mask |= CWHeight;
+	}
+	if (c->bw != c->abw) {
+		wc.border_width = c->abw = c->bw;
+		mask |= CWBorderWidth;
+	}
+	if (mask)
+		XConfigureWindow(dpy, c->win, mask, &wc);
+	return mask;
+}/*}}}*/
+/* poolclear() {{{*/
+/* frees the blocks of p, all its objects have to be put back */
+void poolclear(Pool *p)
+{
+	void *b;
+
+	while ((b = p->blocks)) {
+		p->blocks = *(void **)b;
+		free(b);
+	}
+	p->free = NULL;
+	p->nblocks = 0;
+}/*}}}*/
+/* poolget() {{{*/
+/* a zeroed object of p, to be put back with poolput() */
+void * poolget(Pool *p)
+{
+	/* objects hold a pointer when free and stay aligned for one */
+	size_t i, size = (p->size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	char *b;
+	void *o;
+
+	if (!p->free) {
+		b = ecalloc(1, sizeof(void *) + POOLBLOCK * size);
+		*(void **)b = p->blocks;
+		p->blocks = b;
+		p->nblocks++;
+		for (i = POOLBLOCK; i-- > 0; ) {
+			o = b + sizeof(void *) + i * size;
+			*(void **)o = p->free;
+			p->free = o;
+		}
+	}
+	o = p->free;
+	p->free = *(void **)o;
+	memset(o, 0, p->size);
+	if (++p->live > p->peak)
+		p->peak = p->live;
+	return o;
+}/*}}}*/
+/* poolput() {{{*/
+void poolput(Pool *p, void *o)
+{
+	*(void **)o = p->free;
+	p->free = o;
+	p->live--;
+}/*}}}*/
 /* propertynotify() {{{*/
 void propertynotify(XEvent *e)
 {
@@ -1334,15 +2822,18 @@ void propertynotify(XEvent *e)
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
 		updatestatus();
+	else if (ev->atom == wmatom[WMProtocols] && (c = wintoclient(ev->window)))
+		c->protocols = getprotocols(c->win);
 	else if (ev->state == PropertyDelete)
 		return; /* ignore */
 	else if ((c = wintoclient(ev->window))) {
 		switch(ev->atom) {
 		default: break;
 		case XA_WM_TRANSIENT_FOR:
-			if (!isfloating(c) && (XGetTransientForHint(dpy, c->win, &trans))&&
+			if (!isfloating(c) && (gettransient(c->win, &trans))&&
 				(wintoclient(trans) != NULL)) {
 				c->isfloating = 1;
+				retag(c);
 				arrange(c->mon);
 			}
 			break;
@@ -1354,15 +2845,219 @@ void propertynotify(XEvent *e)
 			drawbars();
 			break;
 		}
-		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
-			if (c == FOCUSED(c->mon))
-				drawbar(c->mon);
+		if ((ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName])
+		&& !c->titlestale) {
+			c->titlestale = 1;
+			nstaletitles++;
 		}
-		if (ev->atom == netatom[NetWMWindowType])
+		if (ev->atom == netatom[NetWMWindowType]) {
 			updatewindowtype(c);
+			retag(c);
+		}
+	}
+}/*}}}*/
+#ifdef RECORD
+/* readevent() {{{*/
+/* the next logged event, with the logged root and bars made current */
+void readevent(XEvent *ev)
+{
+	size_t n;
+	unsigned int i;
+	void *buf = readrec('E', &n);
+
+	if (n > sizeof *ev)
+		die("staticdwm: replay log out of step");
+	memset(ev, 0, sizeof *ev);
+	memcpy(ev, buf, n);
+	free(buf);
+	ev->xany.display = dpy;
+	for (i = 0; i < nrecmap; i++) {
+		if (ev->xany.window == recfrom[i])
+			ev->xany.window = recto[i];
+		if (ev->type == ConfigureNotify && ev->xconfigure.window == recfrom[i])
+			ev->xconfigure.window = recto[i];
+	}
+}/*}}}*/
+/* readrec() {{{*/
+/* next record of the replayed log, which has to be of kind, in a buffer with
+ * a terminating NUL to be freed with free() */
+void * readrec(int kind, size_t *len)
+{
+	uint32_t n;
+	char *buf;
+
+	if (getc(reclog) != kind || fread(&n, sizeof n, 1, reclog) != 1)
+		die("staticdwm: replay log out of step");
+	buf = ecalloc(1, n + 1);
+	if (n && fread(buf, n, 1, reclog) != 1)
+		die("staticdwm: replay log truncated");
+	if (len)
+		*len = n;
+	return buf;
+}/*}}}*/
+/* recdata() {{{*/
+/* Logs len bytes of reply data at p. When replaying they are overwritten
+ * with the logged ones, so handlers see the recorded session. */
+void recdata(void *p, size_t len)
+{
+	size_t n;
+	void *buf;
+
+	if (!reclog)
+		return;
+	if (!replaying) {
+		writerec('R', p, len);
+		return;
+	}
+	buf = readrec('R', &n);
+	if (n != len)
+		die("staticdwm: replay log out of step");
+	memcpy(p, buf, len);
+	free(buf);
+}/*}}}*/
+/* recevent() {{{*/
+void recevent(XEvent *ev)
+{
+	static const size_t size[LASTEvent] = {
+		[ButtonPress] = sizeof(XButtonEvent),
+		[ButtonRelease] = sizeof(XButtonEvent),
+		[ClientMessage] = sizeof(XClientMessageEvent),
+		[ConfigureNotify] = sizeof(XConfigureEvent),
+		[ConfigureRequest] = sizeof(XConfigureRequestEvent),
+		[DestroyNotify] = sizeof(XDestroyWindowEvent),
+		[EnterNotify] = sizeof(XCrossingEvent),
+		[Expose] = sizeof(XExposeEvent),
+		[FocusIn] = sizeof(XFocusChangeEvent),
+		[KeyPress] = sizeof(XKeyEvent),
+		[MappingNotify] = sizeof(XMappingEvent),
+		[MapRequest] = sizeof(XMapRequestEvent),
+		[MotionNotify] = sizeof(XMotionEvent),
+		[PropertyNotify] = sizeof(XPropertyEvent),
+		[UnmapNotify] = sizeof(XUnmapEvent) };
+
+	writerec('E', ev, ev->type < LASTEvent && size[ev->type]
+		? size[ev->type] : sizeof *ev);
+}/*}}}*/
+/* recmapwins() {{{*/
+/* logs the root and bar windows, or maps the logged ones to the current */
+void recmapwins(void)
+{
+	Monitor *m;
+	size_t n;
+	unsigned int i = 1;
+
+	for (m = mons; m; m = m->next)
+		i++;
+	recto = ecalloc(i, sizeof(Window));
+	recto[0] = root;
+	for (i = 1, m = mons; m; m = m->next)
+		recto[i++] = m->barwin;
+	if (!replaying) {
+		writerec('W', recto, i * sizeof(Window));
+		return;
+	}
+	recfrom = readrec('W', &n);
+	nrecmap = MIN(i, n / sizeof(Window));
+}/*}}}*/
+/* recmaskevent() {{{*/
+/* XMaskEvent() for movemouse() and resizemouse() */
+int recmaskevent(Display *d, long mask, XEvent *ev)
+{
+	if (reclog && replaying)
+		readevent(ev);
+	else {
+		(XMaskEvent)(d, mask, ev);
+		recevent(ev);
+	}
+	return 0;
+}/*}}}*/
+/* recopen() {{{*/
+void recopen(const char *path, int replay)
+{
+	char hdr[64], want[64];
+
+	/* the log holds raw structs and only makes sense to the same build */
+	snprintf(want, sizeof want, "staticdwm-record %zu %zu\n",
+		sizeof(XEvent), sizeof(long));
+	if (!(reclog = fopen(path, replay ? "r" : "w")))
+		die("staticdwm: cannot open %s:", path);
+	replaying = replay;
+	if (!replay)
+		fputs(want, reclog);
+	else if (!fgets(hdr, sizeof hdr, reclog) || strcmp(hdr, want))
+		die("staticdwm: %s is not a log of this build", path);
+}/*}}}*/
+/* recstr() {{{*/
+/* logs *s, which is NULL or to be freed with free() */
+void recstr(char **s)
+{
+	size_t n;
+	char *buf;
+
+	if (!reclog)
+		return;
+	if (!replaying) {
+		writerec('S', *s, *s ? strlen(*s) + 1 : 0);
+		return;
+	}
+	buf = readrec('S', &n);
+	free(*s);
+	*s = n ? buf : NULL;
+	if (!n)
+		free(buf);
+}/*}}}*/
+/* recwindows() {{{*/
+/* Logs the children XQueryTree() returned. When replaying they are replaced
+ * by the logged ones, which XFree() can release as it is free() in Xlib. */
+int recwindows(int ok, Window **wins, unsigned int *num)
+{
+	size_t n;
+
+	if (!reclog)
+		return ok;
+	if (!replaying) {
+		recdata(&ok, sizeof ok);
+		if (ok)
+			writerec('T', *wins, *num * sizeof **wins);
+		return ok;
+	}
+	if (ok && *wins)
+		XFree(*wins);
+	*wins = NULL;
+	recdata(&ok, sizeof ok);
+	if (ok) {
+		*wins = readrec('T', &n);
+		*num = n / sizeof **wins;
+	}
+	return ok;
+}/*}}}*/
+/* recwmhints() {{{*/
+XWMHints * recwmhints(XWMHints *wmh)
+{
+	size_t n;
+	void *buf;
+
+	if (!reclog)
+		return wmh;
+	if (!replaying) {
+		writerec('H', wmh, wmh ? sizeof *wmh : 0);
+		return wmh;
 	}
+	buf = readrec('H', &n);
+	if (n == sizeof *wmh) {
+		if (!wmh && !(wmh = XAllocWMHints()))
+			die("staticdwm: cannot allocate hints");
+		memcpy(wmh, buf, n);
+	} else if (n == 0) {
+		if (wmh)
+			XFree(wmh);
+		wmh = NULL;
+	} else
+		die("staticdwm: replay log out of step");
+	free(buf);
+	return wmh;
 }/*}}}*/
+#endif /* RECORD */
 /* recttomon() {{{*/
 Monitor * recttomon(int x, int y, int w, int h)
 {
@@ -1376,6 +3071,17 @@ Monitor * recttomon(int x, int y, int w, int h)
 		}
 	return r;
 }/*}}}*/
+#ifdef XCB
+/* requestmodmap() {{{*/
+/* asks for the modifier mapping updatenumlockmask() reads when it needs it */
+void requestmodmap(void)
+{
+	if (modpending)
+		xcb_discard_reply(xcon, modcookie.sequence);
+	modcookie = xcb_get_modifier_mapping(xcon);
+	modpending = 1;
+}/*}}}*/
+#endif /* XCB */
 /* refocus() {{{*/
 void refocus(void)
 {
@@ -1386,12 +3092,9 @@ void refocus(void)
 			seturgent(c, 0);
 		detachstack(c);
 		attachstack(c);
-		grabbuttons(c, 1);
-		SETBORDERCOL(c);
-		setfocus(c);
-	} else {
-		focusnothing();
 	}
+	/* input focus follows whatever is focused when commit() runs */
+	focusdirty = FocusRefocus;
 	drawbars();
 }/*}}}*/
 /* resize() {{{*/
@@ -1403,41 +3106,84 @@ void resize(Client *c, int x, int y, int w, int h, int interact)
 /* resizeclient() {{{*/
 void resizeclient(Client *c, int x, int y, int w, int h)
 {
-	XWindowChanges wc;
+	unsigned int mask;
 
-	c->x = wc.x = x;
-	c->y = wc.y = y;
-	c->w = wc.width = w;
-	c->h = wc.height = h;
-	wc.border_width = c->bw;
-	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-	configure(c);
-	XSync(dpy, False);
+	c->x = x;
+	c->y = y;
+	c->w = w;
+	c->h = h;
+	if (c->hidden)
+		return; /* showhide() places it when it shows it */
+	mask = placeclient(c, x, y);
+	/* ICCCM 4.1.5, a move without a resize gets no real ConfigureNotify
+	 * the client can trust */
+	if ((mask & (CWX|CWY)) && !(mask & (CWWidth|CWHeight)))
+		configure(c);
 }/*}}}*/
 /* restack() {{{*/
 void restack(Monitor *m)
 {
+	m->dirty |= DirtyRestack|DirtyBar;
+	discardbatched(EnterNotify);
+}/*}}}*/
+/* restackmon() {{{*/
+/* Puts floating clients above the bar and tiled ones in frames below it, then
+ * the hidden tiled ones, the first of the stack on top. Of that order only
+ * the part between the top and bottom it shares with the last one applied is
+ * sent, in one request and, if its top window changed, one more to put that
+ * above the old top. */
+void restackmon(Monitor *m)
+{
+	unsigned int i, j, n = 1;
 	Client *c;
+	Window *w, top;
 	XEvent ev;
 	XWindowChanges wc;
 
-	drawbar(m);
-	wc.stack_mode = Below;
-	wc.sibling = m->barwin;
 	for (c = m->stack; c; c = c->snext)
-		if (!isfloating(c) && isinfrm(c)) {
-			XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
-			wc.sibling = c->win;
-		}
-	wc.sibling = m->barwin;
-	wc.stack_mode = Above;
-	for (c = m->stacklast; c; c = c->sprev)
-		if (isfloating(c)) {
-			XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
-			wc.sibling = c->win;
-		}
+		n++;
+	if (n > m->nstackedmax) {
+		w = m->stacked;
+		m->nstackedmax = MAX(2 * m->nstackedmax, n);
+		m->stacked = ecalloc(2 * m->nstackedmax, sizeof(Window));
+		if (w)
+			memcpy(m->stacked, w, m->nstacked * sizeof(Window));
+		free(w);
+	}
+	w = m->stacked + m->nstackedmax;
+	n = 0;
+	for (c = m->stack; c; c = c->snext)
+		if (isfloating(c))
+			w[n++] = c->win;
+	w[n++] = m->barwin;
+	for (c = m->stack; c; c = c->snext)
+		if (!isfloating(c) && isinfrm(c))
+			w[n++] = c->win;
+	for (c = m->stack; c; c = c->snext)
+		if (!isfloating(c) && !isinfrm(c))
+			w[n++] = c->win;
+	for (i = 0; i < n && i < m->nstacked && w[i] == m->stacked[i]; i++);
+	for (j = 0; i + j < n && i + j < m->nstacked
+			&& w[n - 1 - j] == m->stacked[m->nstacked - 1 - j]; j++);
+	top = m->nstacked ? m->stacked[0] : m->barwin;
+	memcpy(m->stacked, w, n * sizeof(Window));
+	m->nstacked = n;
+	if (i + j == n) /* windows only went away, or nothing changed */
+		return;
+	w = m->stacked;
+	if (i > 0)
+		i--; /* restack below the last unchanged one */
+	else if (w[0] != top) {
+		wc.stack_mode = Above;
+		wc.sibling = top;
+		XConfigureWindow(dpy, w[0], CWSibling|CWStackMode, &wc);
+	}
+	if (n - j - i > 1)
+		XRestackWindows(dpy, w + i, n - j - i);
+	/* the round trip is needed to drop the crossing events restacking caused */
 	XSync(dpy, False);
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	discardbatched(EnterNotify);
 }/*}}}*/
 /* restacksel() {{{*/
 void restacksel(void) 
@@ -1449,17 +3195,160 @@ void restacksel(void)
 	detachstack(f);
 	attachstack(f);
 }/*}}}*/
+/* retag() {{{*/
+/* moves c to the lists of its tag, after its tag or floating state changed */
+void retag(Client *c)
+{
+	if (c->tlist == TAGLIST(c))
+		return;
+	tagdetach(c);
+	tagstackdetach(c);
+	tagattach(c);
+	tagstackattach(c);
+}/*}}}*/
+/* retitle() {{{*/
+/* With retitlerules, applies the tag and floating of the title rules the new
+ * title of c matches, if the last of them is not the one applied before. c
+ * leaves the frames showing it as if it was unmanaged. */
+void retitle(Client *c)
+{
+	unsigned int i, n, rule = 0, tag = c->tag;
+	int isfloating = c->isfloating, focused;
+	const Rule *r;
+	Monitor *m = c->mon;
+
+	if (!c->cold->class) /* transient, rules never applied */
+		return;
+	n = matchrules(c->cold->class->s, c->cold->instance->s, c->name->s);
+	for (i = 0; i < n; i++)
+		if (rules[rulematched[i]].title)
+			rule = rulematched[i] + 1;
+	if (rule == c->cold->titlerule)
+		return;
+	c->cold->titlerule = rule;
+	for (i = 0; i < n; i++) {
+		if (!(r = rules + rulematched[i])->title)
+			continue;
+		if (r->isfloating)
+			c->isfloating = 1;
+		if (r->tag >= 0 && r->tag < NTAGS)
+			c->tag = r->tag;
+	}
+	if (c->tag == tag && c->isfloating == isfloating)
+		return;
+	if ((focused = c == FOCUSED(m)))
+		unfocus(c, 0);
+	if (c == m->frames[m->selfrm].last) /* refill selected */
+		setlast(m, m->selfrm, selwinforselfrm(m, -1));
+	for (i = 0; i < NFRAMES; i++) /* clear others */
+		if (c->frms & 1U << i)
+			setlast(m, i, NULL);
+	retag(c);
+	if (c->isfloating != isfloating) {
+		c->bw = flborderpx;
+		resizeclient(c, c->cold->oldx, c->cold->oldy, c->cold->oldw,
+			c->cold->oldh);
+	}
+	if (focused && m == selmon)
+		refocus();
+	arrange(m);
+}/*}}}*/
+#ifdef RECORD
+/* replay() {{{*/
+/* run() for a logged session: the logged events go to the same handlers, in
+ * the same batches, with the logged replies */
+void replay(void)
+{
+	XEvent ev;
+	int kind;
+	unsigned long nev = 0, nbatches = 0;
+	long long start = nowms();
+
+	commit();
+	XSync(dpy, False);
+	while (running && (kind = getc(reclog)) != EOF) {
+		ungetc(kind, reclog);
+		if (kind == 'B') {
+			free(readrec('B', NULL));
+			commit();
+			XFlush(dpy);
+			nbatches++;
+		} else {
+			readevent(&ev);
+			dispatch(&ev);
+			nev++;
+		}
+	}
+	XSync(dpy, False);
+	fprintf(stderr, "staticdwm: replayed %lu events in %lu batches in %lld ms\n",
+		nev, nbatches, nowms() - start);
+}/*}}}*/
+#endif /* RECORD */
+/* rulefield() {{{*/
+const char * rulefield(const Rule *r, int f)
+{
+	return f == RuleClass ? r->class : f == RuleInstance ? r->instance : r->title;
+}/*}}}*/
+/* rulehits() {{{*/
+/* counts field f of the rules of hit as found, and those now fully found as
+ * matched */
+void rulehits(int f, unsigned int hit)
+{
+	unsigned int r;
+
+	for (; hit; hit = rulechain[f][r]) {
+		r = hit - 1;
+		if (rulestamp[r] != rulestampnow) {
+			rulestamp[r] = rulestampnow;
+			rulefound[r] = 0;
+		}
+		if (rulefound[r] & 1 << f)
+			continue;
+		if ((rulefound[r] |= 1 << f) == ruleneed[r])
+			rulematched[nrulematched++] = r;
+	}
+}/*}}}*/
+/* rulescan() {{{*/
+void rulescan(int f, const char *text)
+{
+	const RuleNode *nodes = rulenodes[f];
+	unsigned int s = 0, c, t;
+
+	rulehits(f, nodes[0].hit); /* empty patterns */
+	for (; *text; text++) {
+		while (!(c = rulestep(nodes, s, *text)) && s)
+			s = nodes[s].fail;
+		for (s = c, t = s; t; t = nodes[t].dict)
+			rulehits(f, nodes[t].hit);
+	}
+}/*}}}*/
+/* rulestep() {{{*/
+unsigned int rulestep(const RuleNode *nodes, unsigned int s, unsigned char c)
+{
+	for (s = nodes[s].child; s && nodes[s].c != c; s = nodes[s].sibling);
+	return s;
+}/*}}}*/
 /* run() {{{*/
 void run(void)
 {
-	XEvent ev;
+	XEvent *ev;
 	/* main event loop */
+	commit();
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type]) {
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		if (!waitevents()) {
+			RECBATCH();
+			commit(); /* timers may have marked work */
+			XFlush(dpy);
+			continue;
+		}
+		drainevents();
+		coalesceevents();
+		for (evbatchpos = 0; running && evbatchpos < nevbatch; evbatchpos++) {
+			ev = evbatch + evbatchpos;
+			dispatch(ev);
 			/*
-			switch (ev.type) {
+			switch (ev->type) {
 			case ButtonPress: testpush('0'); break;
 			case ClientMessage: testpush('1'); break;
 			case ConfigureRequest: testpush('2'); break;
@@ -1477,29 +3366,84 @@ void run(void)
 			}
 			*/
 		}
+		RECBATCH();
+		commit();
+		XFlush(dpy); /* the only flush point of a batch */
+#ifdef METRICS
+		if (inputus) /* input to its action sent to the server */
+			metricadd(stepmetrics + MetInput, inputus, inputrq);
+		inputus = 0;
+#endif /* METRICS */
+	}
+}/*}}}*/
+/* runframehook() {{{*/
+void runframehook(Timer *t)
+{
+	Arg arg;
+
+	if ((arg.v = pendinghook))
+		spawn(&arg);
+	pendinghook = NULL;
+}/*}}}*/
+/* runtimers() {{{*/
+void runtimers(void)
+{
+	Timer *t;
+	long long now = nowms();
+
+	while ((t = timers) && t->due <= now) {
+		timers = t->next;
+		t->armed = 0;
+		t->func(t);
+	}
 }/*}}}*/
 /* scan() {{{*/
 void scan(void)
 {
 	unsigned int i, num;
+	int ok;
 	Window d1, d2, *wins = NULL;
-	XWindowAttributes wa;
+	XWindowAttributes *wa;
+	Prefetch *pf;
+	enum { ScanSkip, ScanManage, ScanTransient } *what;
 
-	if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
-		for (i = 0; i < num; i++) {
-			if (!XGetWindowAttributes(dpy, wins[i], &wa)
-			|| wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
-				continue;
-			if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-				manage(wins[i], &wa);
-		}
-		for (i = 0; i < num; i++) { /* now the transients */
-			if (!XGetWindowAttributes(dpy, wins[i], &wa))
-				continue;
-			if (XGetTransientForHint(dpy, wins[i], &d1)
-			&& (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-				manage(wins[i], &wa);
+	ok = XQueryTree(dpy, root, &d1, &d2, &wins, &num);
+#ifdef RECORD
+	ok = recwindows(ok, &wins, &num);
+#endif /* RECORD */
+	if (ok) {
+		wa = ecalloc(num, sizeof(XWindowAttributes));
+		pf = ecalloc(num, sizeof(Prefetch));
+		what = ecalloc(num, sizeof *what);
+		for (i = 0; i < num; i++) /* all requests go out before any reply */
+			prefetch(pf + i, wins[i]);
+		for (i = 0; i < num; i++) { /* query each window once */
+			curpf = pf + i;
+			if (!getattributes(wins[i], wa + i))
+				what[i] = ScanSkip;
+			else if (wa[i].map_state != IsViewable
+					&& getstate(wins[i]) != IconicState)
+				what[i] = ScanSkip;
+			else if (gettransient(wins[i], &d1))
+				what[i] = ScanTransient;
+			else if (!wa[i].override_redirect)
+				what[i] = ScanManage;
 		}
+		for (i = 0; i < num; i++)
+			if (what[i] == ScanManage) {
+				curpf = pf + i;
+				manage(wins[i], wa + i);
+			}
+		for (i = 0; i < num; i++) /* now the transients */
+			if (what[i] == ScanTransient) {
+				curpf = pf + i;
+				manage(wins[i], wa + i);
+			}
+		for (i = 0; i < num; i++)
+			pfrelease(pf + i);
+		free(what);
+		free(pf);
+		free(wa);
 		if (wins)
 			XFree(wins);
 	}
@@ -1507,16 +3451,12 @@ void scan(void)
 /* sendevent(){{{*/
 int sendevent(Client *c, Atom proto)
 {
-	int n;
-	Atom *protocols;
-	int exists = 0;
+	int i, exists = 0;
 	XEvent ev;
 
-	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
-		while (!exists && n--)
-			exists = protocols[n] == proto;
-		XFree(protocols);
-	}
+	for (i = 0; i < WMLast; i++)
+		if (wmatom[i] == proto)
+			exists = c->protocols & 1 << i;
 	if (exists) {
 		ev.type = ClientMessage;
 		ev.xclient.window = c->win;
@@ -1532,52 +3472,55 @@ int sendevent(Client *c, Atom proto)
 void sendmon(Client *c, Monitor *m)
 {
 	int i;
+	Monitor *o;
 
 	if (!c || !m || c->mon == m)
 		return;
+	o = c->mon;
 	unfocus(c, 1);
+	/* refill while c and the lists walked are still those of o */
+	if (c == o->frames[o->selfrm].last) { /* refill selected */
+		setlast(o, o->selfrm, selwinforselfrm(o, 1));
+		if (o->selfrm == o->focfrm)
+			refocus();
+	}
+	for (i = 0; i < NFRAMES; i++) /* clear others */
+		if (c->frms & 1U << i)
+			setlast(o, i, NULL);
 	detach(c);
 	detachstack(c);
+	unstackwin(o, c->win);
 	c->mon = m;
 	c->tag = (m->frames + m->selfrm)->tag; /* assign tags of selected frame */
 	attach(c);
 	attachstack(c);
-	if (c == selmon->frames[selmon->selfrm].last) { /* refill selected */
-		selmon->frames[selmon->selfrm].last = selwinforselfrm(selmon, 1);
-		if (selmon->selfrm == selmon->focfrm)
-			refocus();
-	}
-	for (i = 0; i < NFRAMES; i++) /* clear others */
-		if (c == selmon->frames[i].last)
-			selmon->frames[i].last = NULL;
 	arrange(NULL);
 }/*}}}*/
 /* selwinforselfrm() {{{*/
+/* only the clients of the frame's tag, or the floating ones, are walked, and
+ * of those only the ones shown in other frames are skipped */
 Client * selwinforselfrm(Monitor * m, int dir)
 {
 	Frame * fr = m->frames + m->selfrm;
-	Client * i, * c = NULL;
+	unsigned int l = m->selfrm ? fr->tag : NTAGS;
+	Client * c = fr->last;
 
+	if (c && c->tlist != l) /* not in the list, start at its end */
+		c = NULL;
 	if (dir == 0) /* try to refill the frame, with most recent if not last*/
 	{
-		c = fr->last;
-		fr->last = NULL;
-		for (; c && !isavailable(c); c = c->snext);
+		setlast(m, m->selfrm, NULL);
+		for (; c && !isavailable(c); c = c->tsnext);
 		if (!c)
-			for (c = m->stack; c && !isavailable(c); c = c->snext);
+			for (c = m->tagstack[l]; c && !isavailable(c); c = c->tsnext);
 	}else if (dir > 0) { /* next in client list*/
-		c = fr->last;
-		for (; c && !isavailable(c); c = c->next);
+		for (; c && !isavailable(c); c = c->tnext);
 		if (!c)
-			for (c = m->clients; c && !isavailable(c); c = c->next);
+			for (c = m->tagclients[l]; c && !isavailable(c); c = c->tnext);
 	} else { /* previous in client list*/
-		for (i = m->clients; i && i != fr->last; i = i->next)
-			if (isavailable(i))
-				c = i;
+		for (c = c ? c->tprev : NULL; c && !isavailable(c); c = c->tprev);
 		if (!c)
-			for (; i; i = i->next)
-				if (isavailable(i))
-					c = i;
+			for (c = m->tagclientslast[l]; c && !isavailable(c); c = c->tprev);
 	}
 	return c;
 }/*}}}*/
@@ -1619,38 +3562,62 @@ void setfullscreen(Client *c, int fullscreen)
 	 * a program's fullscreen mode in any size window */
 	if (fullscreen && !c->isfullscreen) {
 		c->isfullscreen = 1;
-		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
-			PropModeReplace, (unsigned char*)&netatom[NetWMFullscreen], 1);
+		setnetstate(c);
 		configure(c); /* fixes some windows rendering content past edges */
 	} else if (!fullscreen && c->isfullscreen) {
 		c->isfullscreen = 0;
-		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
-			PropModeReplace, (unsigned char*)0, 0);
+		setnetstate(c);
 	}
 }/*}}}*/
+/* setlast() {{{*/
+/* shows c in frame f of m, the only way Frame.last changes once m is set up */
+Client *setlast(Monitor *m, unsigned int f, Client *c)
+{
+	Frame *fr = m->frames + f;
+
+	if (fr->last)
+		fr->last->frms &= ~(1U << f);
+	if ((fr->last = c))
+		c->frms |= 1U << f;
+	return c;
+}/*}}}*/
+/* setnetstate() {{{*/
+void setnetstate(Client *c)
+{
+	Atom state[2];
+	int n = 0;
+
+	if (c->isfullscreen)
+		state[n++] = netatom[NetWMFullscreen];
+	if (c->hidden == HideUnmap)
+		state[n++] = netatom[NetWMHidden];
+	XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
+		PropModeReplace, (unsigned char *) state, n);
+}/*}}}*/
 /* setopenframes() {{{*/
 static void setopenframes(Monitor * m, unsigned int nf)
 {
-	int i, j;
-	Arg arg;
+	int i;
+	Client *c;
 
 	if (nf > NFRAMES)
 		return;
-	for (i = selmon->nopenfrms + 1; i < NFRAMES; i++)
-		for (j = 1; j <= selmon->nopenfrms; j++)
-			if (selmon->frames[i].last == selmon->frames[j].last) {
-				selmon->frames[i].last = NULL;
-				break;
-			}
+	for (i = selmon->nopenfrms + 1; i < NFRAMES; i++) /* forget shown ones */
+		if ((c = selmon->frames[i].last) && c->frms & OPENFRMS(selmon))
+			setlast(selmon, i, NULL);
 	m->nopenfrms = nf;
 	if (nf < nframehooks) {
 		switch(nf) {
-			case 1: arg.v = framehooks[1]; break;
-			case 2: arg.v = framehooks[2]; break;
-			case 3: arg.v = framehooks[3]; break;
-			default: arg.v = framehooks[0];
+			case 1: pendinghook = framehooks[1]; break;
+			case 2: pendinghook = framehooks[2]; break;
+			case 3: pendinghook = framehooks[3]; break;
+			default: pendinghook = framehooks[0];
 		}
-		spawn(&arg);
+		/* only the last of quickly repeated frame changes runs its hook */
+		if (framehookdelay)
+			settimer(&hooktimer, framehookdelay);
+		else
+			runframehook(&hooktimer);
 	}
 }
 /*}}}*/
@@ -1662,15 +3629,60 @@ void setselfrm(Monitor * m, unsigned int frm)
 		m->selfrm = frm;
 	}
 }/*}}}*/
+/* settimer() {{{*/
+/* (re)arms t to fire in ms milliseconds */
+void settimer(Timer *t, unsigned int ms)
+{
+	Timer **tp;
+
+	canceltimer(t);
+	t->due = nowms() + ms;
+	for (tp = &timers; *tp && (*tp)->due <= t->due; tp = &(*tp)->next);
+	t->next = *tp;
+	*tp = t;
+	t->armed = 1;
+}/*}}}*/
 /* setup() {{{*/
 void setup(void)
 {
 	int i;
 	XSetWindowAttributes wa;
 	Atom utf8string;
+	static const char *atomnames[] = { "UTF8_STRING",
+		/* wmatom */
+		"WM_PROTOCOLS", "WM_DELETE_WINDOW", "WM_STATE", "WM_TAKE_FOCUS",
+		/* netatom */
+		"_NET_SUPPORTED", "_NET_WM_NAME", "_NET_WM_STATE",
+		"_NET_SUPPORTING_WM_CHECK", "_NET_WM_STATE_FULLSCREEN",
+		"_NET_ACTIVE_WINDOW", "_NET_WM_WINDOW_TYPE",
+		"_NET_WM_WINDOW_TYPE_DIALOG", "_NET_CLIENT_LIST",
+		"_NET_CLIENT_LIST_STACKING", "_NET_WM_STATE_HIDDEN" };
+	Atom atoms[LENGTH(atomnames)];
+	struct sigaction sa;
 
+	/* signals are only noted by the handler and handled in run() */
+	if (pipe(sigpipe) < 0)
+		die("pipe:");
+	for (i = 0; i < 2; i++)
+		fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC);
+	fcntl(sigpipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(sigpipe[1], F_SETFL, O_NONBLOCK);
+	memset(&sa, 0, sizeof sa);
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART|SA_NOCLDSTOP;
+	sa.sa_handler = sighandler;
+	if (sigaction(SIGCHLD, &sa, NULL) < 0 || sigaction(SIGTERM, &sa, NULL) < 0
+	|| sigaction(SIGUSR1, &sa, NULL) < 0)
+		die("can't install signal handlers:");
 	/* clean up any zombies immediately */
-	sigchld(0);
+	while (0 < waitpid(-1, NULL, WNOHANG));
+	loopstats.start = nowms();
+#ifdef METRICS
+	if (getenv("XDG_RUNTIME_DIR"))
+		snprintf(metricspath, sizeof metricspath, "%s/staticdwm-metrics%s",
+			getenv("XDG_RUNTIME_DIR"), DisplayString(dpy));
+	settimer(&metricstimer, METRICSEVERY);
+#endif /* METRICS */
 
 	/* init screen */
 	screen = DefaultScreen(dpy);
@@ -1684,21 +3696,26 @@ void setup(void)
 	bh = drw->fonts->h + 2;
 	nframehooks = LENGTH(framehooks);
 	updategeom();
-	/* init atoms */
-	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
-	wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
-	wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
-	wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
-	wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
-	netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-	netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
-	netatom[NetWMName] = XInternAtom(dpy, "_NET_WM_NAME", False);
-	netatom[NetWMState] = XInternAtom(dpy, "_NET_WM_STATE", False);
-	netatom[NetWMCheck] = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
-	netatom[NetWMFullscreen] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
-	netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	/* init atoms, XInternAtoms() sends all requests before reading a reply */
+	XInternAtoms(dpy, (char **)atomnames, LENGTH(atomnames), False, atoms);
+	utf8string = atoms[0];
+	for (i = 0; i < WMLast; i++)
+		wmatom[i] = atoms[1 + i];
+	for (i = 0; i < NetLast; i++)
+		netatom[i] = atoms[1 + WMLast + i];
+#ifdef XCB
+	pfatom[PfTransient] = XA_WM_TRANSIENT_FOR;
+	pfatom[PfNetName] = netatom[NetWMName];
+	pfatom[PfName] = XA_WM_NAME;
+	pfatom[PfClass] = XA_WM_CLASS;
+	pfatom[PfNetState] = netatom[NetWMState];
+	pfatom[PfWinType] = netatom[NetWMWindowType];
+	pfatom[PfNormalHints] = XA_WM_NORMAL_HINTS;
+	pfatom[PfHints] = XA_WM_HINTS;
+	pfatom[PfState] = wmatom[WMState];
+	pfatom[PfProtocols] = wmatom[WMProtocols];
+	requestmodmap();
+#endif /* XCB */
 	/* init cursors */
 	cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
 	cursor[CurResize] = drw_cur_create(drw, XC_sizing);
@@ -1722,6 +3739,7 @@ void setup(void)
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
 		PropModeReplace, (unsigned char *) netatom, NetLast);
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	XDeleteProperty(dpy, root, netatom[NetClientListStacking]);
 	/* select events */
 	wa.cursor = cursor[CurNormal]->cursor;
 	wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
@@ -1730,6 +3748,7 @@ void setup(void)
 	XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
 	XSelectInput(dpy, root, wa.event_mask);
 	grabkeys();
+	compilerules(rules, LENGTH(rules));
 	refocus();
 }/*}}}*/
 /* seturgent() {{{*/
@@ -1737,36 +3756,263 @@ void seturgent(Client *c, int urg)
 {
 	XWMHints *wmh;
 
-	c->isurgent = urg;
-	if (!(wmh = XGetWMHints(dpy, c->win)))
+	markurgent(c, urg);
+	if (!(wmh = getwmhints(c->win)))
 		return;
 	wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
 	XSetWMHints(dpy, c->win, wmh);
 	XFree(wmh);
 }/*}}}*/
 /* showhide() {{{*/
-void showhide(Client *c)
+/* shows the clients of m some frame shows, top down, then hides the others,
+ * bottom up, sending only what changed since the last time */
+void showhide(Monitor *m)
 {
-	if (!c)
-		return;
-	if (isinfrm(c)) { 
-		/* show clients top down */
-		XMoveWindow(dpy, c->win, c->x, c->y);
+	int hidden;
+	unsigned int mask;
+	Client *c;
+
+	for (c = m->stack; c; c = c->snext) {
+		if (!isinfrm(c))
+			continue;
+		hidden = c->hidden;
+		c->hidden = 0;
 		if (isfloating(c))
 			resize(c, c->x, c->y, c->w, c->h, 0);
-		showhide(c->snext);
-	} else {
-		/* hide clients bottom up */
-		showhide(c->snext);
-		XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+		mask = placeclient(c, c->x, c->y);
+		/* moved while hidden, see resizeclient() */
+		if ((mask & (CWX|CWY)) && !(mask & (CWWidth|CWHeight)))
+			configure(c);
+		if (hidden == HideUnmap) {
+			XMapWindow(dpy, c->win);
+			setclientstate(c, NormalState);
+			setnetstate(c);
+		}
+	}
+	for (c = m->stacklast; c; c = c->sprev) {
+		if (isinfrm(c))
+			continue;
+		if ((c->hide ? c->hide : hidepolicy) != HideUnmap) {
+			placeclient(c, WIDTH(c) * -2, c->y);
+			c->hidden = HideMove;
+		} else if (c->hidden != HideUnmap) {
+			/* iconic, so clients can stop drawing; the unmap is
+			 * reported to the window and to root */
+			c->ignoreunmap += 2;
+			XUnmapWindow(dpy, c->win);
+			c->hidden = HideUnmap;
+			setclientstate(c, IconicState);
+			setnetstate(c);
+		}
 	}
 }/*}}}*/
-/* sigchld() {{{*/
-void sigchld(int unused)
+/* sighandler() {{{*/
+void sighandler(int sig)
+{
+	int olderrno = errno;
+	unsigned char c = sig;
+
+	if (write(sigpipe[1], &c, 1) < 0) /* a full pipe has work queued anyway */
+		;
+	errno = olderrno;
+}/*}}}*/
+/* tagattach() {{{*/
+/* links c into the clients of its tag, after the closest one before it in
+ * m->clients, so it is O(1) when c was put first */
+void tagattach(Client *c)
+{
+	Monitor *m = c->mon;
+	Client *i, *p = NULL;
+
+	c->tlist = TAGLIST(c);
+	m->ntag[c->tlist]++;
+	m->nurgent[c->tlist] += c->isurgent;
+	for (i = m->clients; i && i != c; i = i->next)
+		if (i->tlist == c->tlist)
+			p = i;
+	c->tprev = p;
+	c->tnext = p ? p->tnext : m->tagclients[c->tlist];
+	if (c->tnext)
+		c->tnext->tprev = c;
+	else
+		m->tagclientslast[c->tlist] = c;
+	if (p)
+		p->tnext = c;
+	else
+		m->tagclients[c->tlist] = c;
+}/*}}}*/
+/* tagdetach() {{{*/
+void tagdetach(Client *c)
+{
+	c->mon->ntag[c->tlist]--;
+	c->mon->nurgent[c->tlist] -= c->isurgent;
+	if (c->tnext)
+		c->tnext->tprev = c->tprev;
+	else
+		c->mon->tagclientslast[c->tlist] = c->tprev;
+	if (c->tprev)
+		c->tprev->tnext = c->tnext;
+	else
+		c->mon->tagclients[c->tlist] = c->tnext;
+}/*}}}*/
+/* tagstackattach() {{{*/
+/* tagattach() for the stack of the tag */
+void tagstackattach(Client *c)
+{
+	Monitor *m = c->mon;
+	Client *i, *p = NULL;
+
+	for (i = m->stack; i && i != c; i = i->snext)
+		if (i->tlist == c->tlist)
+			p = i;
+	c->tsprev = p;
+	c->tsnext = p ? p->tsnext : m->tagstack[c->tlist];
+	if (c->tsnext)
+		c->tsnext->tsprev = c;
+	if (p)
+		p->tsnext = c;
+	else
+		m->tagstack[c->tlist] = c;
+}/*}}}*/
+/* tagstackdetach() {{{*/
+void tagstackdetach(Client *c)
+{
+	if (c->tsnext)
+		c->tsnext->tsprev = c->tsprev;
+	if (c->tsprev)
+		c->tsprev->tsnext = c->tsnext;
+	else
+		c->mon->tagstack[c->tlist] = c->tsnext;
+}/*}}}*/
+/* textprop() {{{*/
+/* text of property atom of w, to be freed with free(), NULL if w has none */
+char * textprop(Window w, Atom atom)
+{
+	char **list = NULL, *s = NULL, *v = "";
+	int n, ok;
+	size_t len;
+	XTextProperty name;
+#ifdef XCB
+	xcb_get_property_reply_t *r, *rest = NULL;
+	size_t restlen = 0;
+
+	if ((ok = (r = getprop(w, atom, 1024)) && r->type != None && r->value_len)) {
+		len = xcb_get_property_value_length(r);
+		/* the words past the first 1024, len is a multiple of 4 then */
+		if (r->bytes_after && (rest = xcb_get_property_reply(xcon,
+			xcb_get_property(xcon, 0, w, atom, r->type, len / 4,
+			(r->bytes_after + 3) / 4), NULL)) && rest->format == r->format)
+			restlen = xcb_get_property_value_length(rest);
+		/* NUL terminated copy, like the one XGetTextProperty() returns */
+		name.value = ecalloc(1, len + restlen + 1);
+		memcpy(name.value, xcb_get_property_value(r), len);
+		if (restlen)
+			memcpy(name.value + len, xcb_get_property_value(rest), restlen);
+		name.encoding = r->type;
+		name.format = r->format;
+		name.nitems = r->value_len + (restlen ? rest->value_len : 0);
+	}
+	free(r);
+	free(rest);
+#else
+	ok = XGetTextProperty(dpy, w, &name, atom) && name.nitems;
+#endif /* XCB */
+	if (ok) {
+		if (name.encoding == XA_STRING)
+			v = (char *)name.value;
+		else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success
+		&& n > 0 && *list)
+			v = *list;
+		len = strlen(v);
+		s = ecalloc(1, len + 1);
+		memcpy(s, v, len);
+		if (list)
+			XFreeStringList(list);
+#ifdef XCB
+		free(name.value);
+#else
+		XFree(name.value);
+#endif /* XCB */
+	}
+#ifdef RECORD
+	recstr(&s);
+#endif /* RECORD */
+	return s;
+}/*}}}*/
+/* titleget() {{{*/
+/* the Title holding s, shared with the clients already showing it, to be
+ * released with titleput() */
+Title * titleget(const char *s)
+{
+	unsigned int hash = 2166136261U; /* FNV-1a */
+	size_t len;
+	Title *t;
+
+	for (len = 0; s[len]; len++)
+		hash = (hash ^ (unsigned char)s[len]) * 16777619U;
+	for (t = titles[hash % LENGTH(titles)]; t; t = t->next)
+		if (t->hash == hash && t->len == len && !memcmp(t->s, s, len)) {
+			t->refs++;
+			return t;
+		}
+	t = ecalloc(1, sizeof(Title) + len + 1);
+	t->hash = hash;
+	t->refs = 1;
+	t->len = len;
+	memcpy(t->s, s, len);
+	t->next = titles[hash % LENGTH(titles)];
+	titles[hash % LENGTH(titles)] = t;
+	return t;
+}/*}}}*/
+/* titleput() {{{*/
+void titleput(Title *t)
+{
+	Title **tp;
+
+	if (!t || --t->refs)
+		return;
+	for (tp = &titles[t->hash % LENGTH(titles)]; *tp != t; tp = &(*tp)->next);
+	*tp = t->next;
+	free(t);
+}/*}}}*/
+/* titleshown() {{{*/
+/* returns the length of a prefix of s too wide for w pixels, which decides
+ * all drw_text() shows of s, or 0 if s fits */
+unsigned int titleshown(const char *s, unsigned int w)
+{
+	char buf[1024];
+	unsigned int lo = 0, hi = strlen(s), mid;
+
+	if (drw_fontset_getwidth(drw, s) <= w)
+		return 0;
+	if (hi >= sizeof buf) { /* drw_text() shows no more of a font */
+		hi = sizeof buf - 1;
+		memcpy(buf, s, hi);
+		buf[hi] = '\0';
+		if (drw_fontset_getwidth(drw, buf) <= w)
+			return 0;
+	}
+	/* hi is too wide and lo is not, halved on character boundaries */
+	while (hi - lo > 1) {
+		for (mid = (lo + hi) / 2; mid > lo && (s[mid] & 0xc0) == 0x80; mid--);
+		if (mid == lo)
+			for (mid = (lo + hi) / 2; mid < hi && (s[mid] & 0xc0) == 0x80;
+				mid++);
+		if (mid == hi)
+			break;
+		memcpy(buf, s, mid);
+		buf[mid] = '\0';
+		if (drw_fontset_getwidth(drw, buf) > w)
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return hi;
+}/*}}}*/
+/* titletimeout() {{{*/
+/* wakes the event loop, whose commit() then fetches the titles due */
+void titletimeout(Timer *t)
 {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
-	while (0 < waitpid(-1, NULL, WNOHANG));
 }/*}}}*/
 /* unfocus() {{{*/
 void unfocus(Client *c, int setfocus)
@@ -1778,6 +4024,41 @@ void unfocus(Client *c, int setfocus)
 	if (setfocus)
 		focusnothing();
 }/*}}}*/
+/* unlistclient() {{{*/
+void unlistclient(Window w)
+{
+	unsigned int i;
+
+	for (i = 0; i < nclientwins && clientwins[i] != w; i++);
+	if (i == nclientwins)
+		return;
+	memmove(clientwins + i, clientwins + i + 1,
+		(--nclientwins - i) * sizeof(Window));
+	listsdirty |= ListClients|ListStacking;
+}/*}}}*/
+/* unindexwin() {{{*/
+void unindexwin(Window w)
+{
+	unsigned int i, j, h, mask;
+	WinSlot *s;
+
+	if (!(s = lookupwin(w)))
+		return;
+	mask = (1U << wintabbits) - 1;
+	i = s - wintab;
+	/* shift back later entries of the probe run instead of tombstoning */
+	for (j = (i + 1) & mask; wintab[j].win; j = (j + 1) & mask) {
+		h = WINHASH(wintab[j].win);
+		if (((j - h) & mask) >= ((j - i) & mask)) {
+			wintab[i] = wintab[j];
+			i = j;
+		}
+	}
+	wintab[i].win = 0;
+	wintab[i].c = NULL;
+	wintab[i].m = NULL;
+	wintabused--;
+}/*}}}*/
 /* unmanage() {{{*/
 void unmanage(Client *c, int destroyed)
 {
@@ -1792,11 +4073,12 @@ void unmanage(Client *c, int destroyed)
 	focusto = c->focusto;
 	while (c->focusfrom) { /* clear focusto references to this client */
 		ClientLink * todel = c->focusfrom;
+		Client * from = todel->c;
 
-		c->focusfrom->c->focusto = focusto;
-		attachfocus(c->focusfrom->c); /* focus c's focusto instead of c*/
-		c->focusfrom = c->focusfrom->next;
-		free(todel);
+		c->focusfrom = todel->next;
+		poolput(&pools[PoolLink], todel); /* reused by attachfocus() */
+		from->focusto = focusto;
+		attachfocus(from); /* focus c's focusto instead of c*/
 	}
 	c->focusfrom = focusto ? focusto->focusfrom : 0;
 	while (c->focusfrom) { /* clear focusfrom reference to this client */
@@ -1807,20 +4089,23 @@ void unmanage(Client *c, int destroyed)
 				focusto->focusfrom = c->focusfrom->next;
 			if (c->focusfrom->next)
 				c->focusfrom->next->prev = c->focusfrom->prev;
-			free(c->focusfrom);
+			poolput(&pools[PoolLink], c->focusfrom);
 			break;
 		}
 		c->focusfrom = c->focusfrom->next;
 	}
 	if (c == m->frames[m->selfrm].last) /* refill selected */
-		m->frames[m->selfrm].last = selwinforselfrm(m, -1);
+		setlast(m, m->selfrm, selwinforselfrm(m, -1));
 	for (i = 0; i < NFRAMES; i++) /* clear others */
-		if (c == selmon->frames[i].last)
-			selmon->frames[i].last = NULL;
+		if (c->frms & 1U << i)
+			setlast(m, i, NULL);
 	detach(c);
 	detachstack(c);
+	unindexwin(c->win);
+	unlistclient(c->win);
+	unstackwin(m, c->win);
 	if (!destroyed) {
-		wc.border_width = c->oldbw;
+		wc.border_width = c->cold->oldbw;
 		XGrabServer(dpy); /* avoid race conditions */
 		XSetErrorHandler(xerrordummy);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
@@ -1830,8 +4115,13 @@ void unmanage(Client *c, int destroyed)
 		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
 	}
-	free(c);
-	updateclientlist();
+	if (c->titlestale)
+		nstaletitles--;
+	titleput(c->name);
+	titleput(c->cold->class);
+	titleput(c->cold->instance);
+	poolput(&pools[PoolCold], c->cold);
+	poolput(&pools[PoolClient], c);
 	if (m == selmon) {
 		if (focusto)
 			focusclient(focusto);
@@ -1847,12 +4137,27 @@ void unmapnotify(XEvent *e)
 	XUnmapEvent *ev = &e->xunmap;
 
 	if ((c = wintoclient(ev->window))) {
-		if (ev->send_event)
+		if (!ev->send_event && c->ignoreunmap)
+			c->ignoreunmap--; /* hidden by showhide() */
+		else if (ev->send_event && c->hidden != HideUnmap)
 			setclientstate(c, WithdrawnState);
-		else
+		else /* a client unmapped by showhide() withdraws with the event */
 			unmanage(c, 0);
 	}
 }/*}}}*/
+/* unstackwin() {{{*/
+/* drops w, leaving m, from the order restackmon() applied, so it is restacked
+ * wherever it shows up again */
+void unstackwin(Monitor *m, Window w)
+{
+	unsigned int i;
+
+	for (i = 0; i < m->nstacked && m->stacked[i] != w; i++);
+	if (i == m->nstacked)
+		return;
+	memmove(m->stacked + i, m->stacked + i + 1,
+		(--m->nstacked - i) * sizeof(Window));
+}/*}}}*/
 /* updatebars() {{{*/
 void updatebars(void)
 {
@@ -1870,6 +4175,7 @@ void updatebars(void)
 				DefaultDepth(dpy, screen), CopyFromParent,
 				DefaultVisual(dpy, screen),
 				CWOverrideRedirect|CWBackPixmap|CWEventMask, &wa);
+		indexwin(m->barwin, NULL, m);
 		XDefineCursor(dpy, m->barwin, cursor[CurNormal]->cursor);
 		XMapRaised(dpy, m->barwin);
 		XSetClassHint(dpy, m->barwin, &ch);
@@ -1894,22 +4200,37 @@ void updateborder(Client * c, int bw)
 
 	if (!c || bw < 0)
 		return;
-	wc.border_width = c->bw = bw;
+	if ((c->bw = bw) == c->abw)
+		return;
+	wc.border_width = c->abw = bw;
 	XConfigureWindow(dpy, c->win, CWBorderWidth, &wc);
 	/*configure(c);*/
 }/*}}}*/
 /* updateclientlist() {{{*/
+/* publishes the client lists listsdirty marks, the stacking one, from the
+ * orders restackmon() applied, only if it differs from the published one */
 void updateclientlist(void)
 {
-	Client *c;
+	unsigned int i, n = 0;
 	Monitor *m;
 
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList],
-				XA_WINDOW, 32, PropModeAppend,
-				(unsigned char *) &(c->win), 1);
+	if (listsdirty & ListClients)
+		XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32,
+			PropModeReplace, (unsigned char *) clientwins, nclientwins);
+	if (listsdirty & ListStacking) {
+		for (m = mons; m; m = m->next)
+			for (i = m->nstacked; i-- > 0; )
+				if (m->stacked[i] != m->barwin)
+					stackwinsnew[n++] = m->stacked[i];
+		if (n != nstackwins
+				|| (n && memcmp(stackwins, stackwinsnew, n * sizeof(Window)))) {
+			memcpy(stackwins, stackwinsnew, n * sizeof(Window));
+			nstackwins = n;
+			XChangeProperty(dpy, root, netatom[NetClientListStacking], XA_WINDOW,
+				32, PropModeReplace, (unsigned char *) stackwins, nstackwins);
+		}
+	}
+	listsdirty = 0;
 }/*}}}*/
 /* updatefrmpos() {{{*/
 void updatefrmpos(Monitor * m)
@@ -1984,6 +4305,7 @@ int updategeom(void)
 					dirty = 1;
 					m->clients = c->next;
 					detachstack(c);
+					c->frms = 0; /* shown by m only */
 					c->mon = mons;
 					attach(c);
 					attachstack(c);
@@ -2017,8 +4339,29 @@ int updategeom(void)
 void updatenumlockmask(void)
 {
 	unsigned int i, j;
+#ifdef XCB
+	xcb_get_modifier_mapping_reply_t *modmap;
+	xcb_keycode_t *codes, numlock;
+
+	if (!modpending) /* unchanged since the last MappingNotify */
+		return;
+	modpending = 0;
+	numlockmask = 0;
+	if ((modmap = xcb_get_modifier_mapping_reply(xcon, modcookie, NULL))) {
+		codes = xcb_get_modifier_mapping_keycodes(modmap);
+		numlock = XKeysymToKeycode(dpy, XK_Num_Lock);
+		for (i = 0; i < 8; i++)
+			for (j = 0; j < modmap->keycodes_per_modifier; j++)
+				if (codes[i * modmap->keycodes_per_modifier + j] == numlock)
+					numlockmask = (1 << i);
+		free(modmap);
+	}
+#else
 	XModifierKeymap *modmap;
 
+	if (!modpending) /* unchanged since the last MappingNotify */
+		return;
+	modpending = 0;
 	numlockmask = 0;
 	modmap = XGetModifierMapping(dpy);
 	for (i = 0; i < 8; i++)
@@ -2027,56 +4370,63 @@ void updatenumlockmask(void)
 				== XKeysymToKeycode(dpy, XK_Num_Lock))
 				numlockmask = (1 << i);
 	XFreeModifiermap(modmap);
+#endif /* XCB */
+	RECDATA(&numlockmask, sizeof numlockmask);
 }/*}}}*/
 /* updatesizehints() {{{*/
 void updatesizehints(Client *c)
 {
-	long msize;
 	XSizeHints size;
 
-	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
+	if (!getsizehints(c->win, &size))
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
 	if (size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
+		c->cold->basew = size.base_width;
+		c->cold->baseh = size.base_height;
 	} else if (size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
+		c->cold->basew = size.min_width;
+		c->cold->baseh = size.min_height;
 	} else
-		c->basew = c->baseh = 0;
+		c->cold->basew = c->cold->baseh = 0;
 	if (size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
+		c->cold->incw = size.width_inc;
+		c->cold->inch = size.height_inc;
 	} else
-		c->incw = c->inch = 0;
+		c->cold->incw = c->cold->inch = 0;
 	if (size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
+		c->cold->maxw = size.max_width;
+		c->cold->maxh = size.max_height;
 	} else
-		c->maxw = c->maxh = 0;
+		c->cold->maxw = c->cold->maxh = 0;
 	if (size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
+		c->cold->minw = size.min_width;
+		c->cold->minh = size.min_height;
 	} else if (size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
+		c->cold->minw = size.base_width;
+		c->cold->minh = size.base_height;
 	} else
-		c->minw = c->minh = 0;
+		c->cold->minw = c->cold->minh = 0;
 	if (size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+		c->cold->mina = (float)size.min_aspect.y / size.min_aspect.x;
+		c->cold->maxa = (float)size.max_aspect.x / size.max_aspect.y;
 	} else
-		c->maxa = c->mina = 0.0;
-	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
+		c->cold->maxa = c->cold->mina = 0.0;
+	c->isfixed = (c->cold->maxw && c->cold->maxh && c->cold->maxw == c->cold->minw && c->cold->maxh == c->cold->minh);
 }/*}}}*/
 /* updatetitle() {{{*/
-void updatetitle(Client *c)
+/* returns the previous title, to be released with titleput() */
+Title * updatetitle(Client *c)
 {
-	if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-	if (c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	char *s;
+	Title *t = c->name;
+
+	if (!(s = textprop(c->win, netatom[NetWMName])))
+		s = textprop(c->win, XA_WM_NAME);
+	/* broken is a hack to mark broken clients */
+	c->name = titleget(s && *s ? s : broken);
+	free(s);
+	return t;
 }/*}}}*/
 /* updatestatus() {{{*/
 void updatestatus(void)
@@ -2104,12 +4454,12 @@ void updatewmhints(Client *c)
 {
 	XWMHints *wmh;
 
-	if ((wmh = XGetWMHints(dpy, c->win))) {
+	if ((wmh = getwmhints(c->win))) {
 		if (c == FOCUSED(selmon) && wmh->flags & XUrgencyHint) {
 			wmh->flags &= ~XUrgencyHint;
 			XSetWMHints(dpy, c->win, wmh);
 		} else
-			c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
+			markurgent(c, (wmh->flags & XUrgencyHint) ? 1 : 0);
 		if (wmh->flags & InputHint)
 			c->neverfocus = !wmh->input;
 		else
@@ -2117,34 +4467,140 @@ void updatewmhints(Client *c)
 		XFree(wmh);
 	}
 }/*}}}*/
+/* waitevents() {{{*/
+/* Sleeps until the X connection or the signal pipe is readable or the next
+ * timer is due, then handles signals and timers. Returns whether X events
+ * are queued. */
+int waitevents(void)
+{
+	struct pollfd pfd[2];
+
+	if (XPending(dpy))
+		return 1;
+	pfd[0].fd = ConnectionNumber(dpy);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = sigpipe[0];
+	pfd[1].events = POLLIN;
+	if (poll(pfd, LENGTH(pfd), nexttimeout()) < 0) {
+		if (errno != EINTR)
+			die("poll:");
+		pfd[1].revents = 0;
+	}
+	loopstats.wakeups++;
+	if (pfd[1].revents & POLLIN)
+		handlesignals();
+	runtimers();
+	return XPending(dpy);
+}/*}}}*/
 /* wintoclient() {{{*/
 Client * wintoclient(Window w)
 {
-	Client *c;
-	Monitor *m;
+	WinSlot *s = lookupwin(w);
 
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			if (c->win == w)
-				return c;
-	return NULL;
+	return s ? s->c : NULL;
 }/*}}}*/
 /* wintomon() {{{*/
 Monitor * wintomon(Window w)
 {
 	int x, y;
-	Client *c;
-	Monitor *m;
+	WinSlot *s;
 
 	if (w == root && getrootptr(&x, &y))
 		return recttomon(x, y, 1, 1);
-	for (m = mons; m; m = m->next)
-		if (w == m->barwin)
-			return m;
-	if ((c = wintoclient(w)))
-		return c->mon;
+	if ((s = lookupwin(w)))
+		return s->c ? s->c->mon : s->m;
 	return selmon;
 }/*}}}*/
+#ifdef METRICS
+/* writemetrics() {{{*/
+/* Replaces metricspath with one line per metric that was hit. Percentiles
+ * are the upper bound of their bucket. t is NULL if not called by the timer. */
+void writemetrics(Timer *t)
+{
+	static const char *evnames[LASTEvent] = {
+		[ButtonPress] = "ButtonPress", [ClientMessage] = "ClientMessage",
+		[ConfigureRequest] = "ConfigureRequest",
+		[ConfigureNotify] = "ConfigureNotify", [DestroyNotify] = "DestroyNotify",
+		[EnterNotify] = "EnterNotify", [Expose] = "Expose",
+		[FocusIn] = "FocusIn", [KeyPress] = "KeyPress",
+		[MappingNotify] = "MappingNotify", [MapRequest] = "MapRequest",
+		[MotionNotify] = "MotionNotify", [PropertyNotify] = "PropertyNotify",
+		[UnmapNotify] = "UnmapNotify" };
+	static const char *stepnames[MetLast] = {
+		[MetArrange] = "arrange", [MetRestack] = "restack",
+		[MetDrawbar] = "drawbar", [MetManage] = "manage",
+		[MetInput] = "input" };
+	struct { const char *kind; Metric *m; unsigned int n; } sets[] = {
+		{ "event", evmetrics, LENGTH(evmetrics) },
+		{ "step", stepmetrics, LENGTH(stepmetrics) },
+		{ "key", keymetrics, LENGTH(keymetrics) },
+		{ "button", buttonmetrics, LENGTH(buttonmetrics) } };
+	char tmp[PATH_MAX + 4], name[64];
+	const char *sym;
+	unsigned long sum, p50, p99;
+	unsigned int i, j;
+	int b;
+	Metric *m;
+	FILE *f;
+
+	if (t)
+		settimer(t, METRICSEVERY);
+	if (!metricspath[0])
+		return;
+	snprintf(tmp, sizeof tmp, "%s.new", metricspath);
+	if (!(f = fopen(tmp, "w")))
+		return;
+	fprintf(f, "# name calls p50_us p99_us max_us xrequests\n");
+	for (i = 0; i < LENGTH(sets); i++)
+		for (j = 0; j < sets[i].n; j++) {
+			if (!(m = sets[i].m + j)->n)
+				continue;
+			if (sets[i].m == evmetrics)
+				snprintf(name, sizeof name, "%s", evnames[j] ? evnames[j] : "?");
+			else if (sets[i].m == stepmetrics)
+				snprintf(name, sizeof name, "%s", stepnames[j]);
+			else if (sets[i].m == keymetrics) {
+				sym = XKeysymToString(keys[j].keysym);
+				snprintf(name, sizeof name, "%s+%#x", sym ? sym : "?",
+					keys[j].mod);
+			} else
+				snprintf(name, sizeof name, "%u+%#x,click%u",
+					buttons[j].button, buttons[j].mask, buttons[j].click);
+			for (b = 0, sum = 0, p50 = p99 = 0; b < NBUCKETS; b++) {
+				sum += m->bucket[b];
+				if (!p50 && sum * 2 >= m->n)
+					p50 = 1UL << b;
+				if (!p99 && sum * 100 >= m->n * 99)
+					p99 = 1UL << b;
+			}
+			fprintf(f, "%s.%s %lu %lu %lu %lld %lu\n", sets[i].kind, name,
+				m->n, p50, p99, m->max, m->reqs);
+		}
+	fprintf(f, "# name live peak allocated\n");
+	for (i = 0; i < PoolLast; i++)
+		fprintf(f, "pool.%s %lu %lu %lu\n", pools[i].name, pools[i].live,
+			pools[i].peak, pools[i].nblocks * POOLBLOCK);
+	if (fclose(f) == 0)
+		rename(tmp, metricspath);
+	else
+		unlink(tmp);
+}/*}}}*/
+#endif /* METRICS */
+#ifdef RECORD
+/* writerec() {{{*/
+/* appends a record of kind to the log being recorded */
+void writerec(int kind, const void *p, size_t len)
+{
+	uint32_t n = len;
+
+	if (!reclog || replaying)
+		return;
+	putc(kind, reclog);
+	fwrite(&n, sizeof n, 1, reclog);
+	if (len)
+		fwrite(p, len, 1, reclog);
+}/*}}}*/
+#endif /* RECORD */
 /* xerror() {{{*/
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
@@ -2185,19 +4641,40 @@ int main(int argc, char *argv[])
 
 	if (argc == 2 && !strcmp("-v", argv[1]))
 		die("staticdwm-"VERSION);
+#ifdef RECORD
+	else if (argc == 3 && (!strcmp("-r", argv[1]) || !strcmp("-p", argv[1])))
+		recopen(argv[2], argv[1][1] == 'p');
+	else if (argc != 1)
+		die("usage: staticdwm [-v] [-r log | -p log]");
+#else
 	else if (argc != 1)
 		die("usage: staticdwm [-v]");
+#endif /* RECORD */
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
 	if (!(dpy = XOpenDisplay(NULL)))
 		die("staticdwm: cannot open display");
+#ifdef XCB
+	xcon = XGetXCBConnection(dpy);
+#endif /* XCB */
 	checkotherwm();
 	setup();
+#ifdef RECORD
+	if (reclog)
+		recmapwins();
+	if (replaying) /* the logged windows do not exist here */
+		XSetErrorHandler(xerrordummy);
+#endif /* RECORD */
 	scan();
 	updatefrmpos(selmon);
 	arrange(selmon);
 	for (m = mons; m; m = m->next) /* call frame swap hooks on start */
 		setopenframes(m, m->nopenfrms);
+#ifdef RECORD
+	if (replaying)
+		replay();
+	else
+#endif /* RECORD */
 	run();
 	cleanup();
 	XCloseDisplay(dpy);
@@ -2262,7 +4739,7 @@ void emptyframe(const Arg *arg)
 {
 	if (selmon->selfrm == selmon->focfrm)
 		unfocus(FOCUSED(selmon), 0);
-	selmon->frames[selmon->selfrm].last = NULL;
+	setlast(selmon, selmon->selfrm, NULL);
 	if (selmon->selfrm == selmon->focfrm)
 		focusnothing();
 	arrange(selmon);
@@ -2275,7 +4752,7 @@ void fillframe(const Arg *arg)
 	if (arg && (c = selwinforselfrm(selmon, arg->i))) {
 		if (selmon->selfrm == selmon->focfrm)
 			unfocus(FOCUSED(selmon), 0);
-		selmon->frames[selmon->selfrm].last = c;
+		setlast(selmon, selmon->selfrm, c);
 		if (selmon->selfrm == selmon->focfrm)
 			refocus();
 		else
@@ -2342,6 +4819,7 @@ void movemouse(const Arg *arg)
 	if (!(c = FOCUSED(selmon)))
 		return;
 	restack(selmon);
+	commit();
 	ocx = c->x;
 	ocy = c->y;
 	if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
@@ -2356,6 +4834,7 @@ void movemouse(const Arg *arg)
 		case Expose:
 		case MapRequest:
 			handler[ev.type](&ev);
+			commit();
 			break;
 		case MotionNotify:
 			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
@@ -2374,8 +4853,9 @@ void movemouse(const Arg *arg)
 				ny = selmon->wy + selmon->wh - HEIGHT(c);
 			if (!isfloating(c) && (abs(nx - c->x) > snap
 							   || abs(ny - c->y) > snap)) {
-				c->oldx = nx; c->oldy = ny; c->oldw = c->w; c->oldh = c->h;
+				c->cold->oldx = nx; c->cold->oldy = ny; c->cold->oldw = c->w; c->cold->oldh = c->h;
 				togglefloating(NULL);
+				commit();
 			}
 			if (isfloating(c))
 				resize(c, nx, ny, c->w, c->h, 1);
@@ -2422,6 +4902,7 @@ void resizemouse(const Arg *arg)
 	if (!(c = FOCUSED(selmon)))
 		return;
 	restack(selmon);
+	commit();
 	ocx = c->x;
 	ocy = c->y;
 	if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
@@ -2436,6 +4917,7 @@ void resizemouse(const Arg *arg)
 		case Expose:
 		case MapRequest:
 			handler[ev.type](&ev);
+			commit();
 			break;
 		case MotionNotify:
 			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
@@ -2451,8 +4933,9 @@ void resizemouse(const Arg *arg)
 			{
 				if (!isfloating(c) && (abs(nw - c->w) > snap
 								   || abs(nh - c->h) > snap)) {
-					c->oldx = c->x; c->oldy = c->y; c->oldw = nw; c->oldh = nh;
+					c->cold->oldx = c->x; c->cold->oldy = c->y; c->cold->oldw = nw; c->cold->oldh = nh;
 					togglefloating(NULL);
+					commit();
 				}
 			}
 			if (isfloating(c))
@@ -2488,6 +4971,10 @@ void spawn(const Arg *arg)
 {
 	if (!arg)
 		return;
+#ifdef RECORD
+	if (replaying) /* nothing the log needs */
+		return;
+#endif /* RECORD */
 	if (arg->v == dmenucmd)
 		dmenumon[0] = '0' + selmon->num;
 	if (fork() == 0) {
@@ -2551,18 +5038,20 @@ void tag(const Arg *arg)
 	c->tag = arg->ui;
 	if (c->isfloating) {
 		c->isfloating = 0;
+		retag(c);
 		if (selmon->selfrm == selmon->focfrm) {
 			updateborder(c, borderpx);
 			SETBORDERCOL(c);
 			unfocus(c, 0);
-			c = selmon->frames->last = selwinforselfrm(selmon, 0);
+			c = setlast(selmon, 0, selwinforselfrm(selmon, 0));
 			focusclient(c);
 		}
 		arrange(selmon);
 	} else {
+		retag(c);
 		if (selmon->selfrm == selmon->focfrm)
 			unfocus(fr->last, 0);
-		fr->last = selwinforselfrm(selmon, 0);
+		setlast(selmon, selmon->selfrm, selwinforselfrm(selmon, 0));
 		if (selmon->selfrm == selmon->focfrm)
 			refocus();
 		else
@@ -2578,6 +5067,7 @@ void tagandview(const Arg *arg)
 		fr->last->isfloating)
 		return;
 	fr->last->tag = arg->ui;
+	retag(fr->last);
 	fr->tag = arg->ui;
 	drawbars();
 }/*}}}*/
@@ -2602,16 +5092,16 @@ void togglebar(const Arg *arg)
 void togglefloating(const Arg *arg)
 {
 	Client * c = SELECTED(selmon);
-	Frame * fr = selmon->frames + selmon->selfrm;
 
 	if (!c)
 		return;
 	if (!isfloating(c)) {
 		c->isfloating = 1;
+		retag(c);
 		c->bw = flborderpx;
-		resizeclient(c, c->oldx, c->oldy, c->oldw, c->oldh);
+		resizeclient(c, c->cold->oldx, c->cold->oldy, c->cold->oldw, c->cold->oldh);
 		c->lastfrm = selmon->selfrm;
-		fr->last = selwinforselfrm(selmon, 0);
+		setlast(selmon, selmon->selfrm, selwinforselfrm(selmon, 0));
 		if (selmon->selfrm == selmon->focfrm) {
 			setfocfrm(selmon, 0);
 			setselfrm(selmon, 0);
@@ -2619,26 +5109,27 @@ void togglefloating(const Arg *arg)
 			setselfrm(selmon, 0);
 			restack(selmon);
 		}
-		selmon->frames->last = c;
+		setlast(selmon, 0, c);
 		arrange(selmon);
 	} else {
 		c->isfloating = 0;
+		retag(c);
 		updateborder(c, borderpx);
-		c->oldx = c->x; c->oldy = c->y; c->oldw = c->w; c->oldh = c->h;
+		c->cold->oldx = c->x; c->cold->oldy = c->y; c->cold->oldw = c->w; c->cold->oldh = c->h;
 		if (c->lastfrm > 0 && c->lastfrm <= selmon->nopenfrms &&
 				selmon->frames[c->lastfrm].tag == c->tag) {
 			if (selmon->selfrm == selmon->focfrm) {
 				setfocfrm(selmon, c->lastfrm);
 				setselfrm(selmon, c->lastfrm);
-				SELECTED(selmon) = c;
+				setlast(selmon, selmon->selfrm, c);
 			} else {
 				setselfrm(selmon, c->lastfrm);
-				if (selmon->focfrm != selmon->selfrm)
-					SELECTED(selmon) = c; /* don't fill focused frame */
+				if (selmon->focfrm != selmon->selfrm) /* don't fill focused */
+					setlast(selmon, selmon->selfrm, c);
 			}
 		} else if (selmon->selfrm == selmon->focfrm) {
 			unfocus(c, 0);
-			focusclient((selmon->frames->last = selwinforselfrm(selmon, 0)));
+			focusclient(setlast(selmon, 0, selwinforselfrm(selmon, 0)));
 		}
 		arrange(selmon);
 	}
@@ -2661,7 +5152,7 @@ void toggleframe(const Arg *arg)
 		setselfrm(selmon, sel);
 		/*refill tiled frame previously filled with floating client*/
 		if (selmon->selfrm && (isfloating(FOCUSED(selmon))))
-			FOCUSED(selmon) = NULL;
+			setlast(selmon, selmon->focfrm, NULL);
 		refocus();
 		arrange(selmon);
 	}
@@ -2678,7 +5169,7 @@ void view(const Arg *arg)
 	if (selmon->selfrm == selmon->focfrm)
 		unfocus(fr->last, 0);
 	fr->tag = tag;
-	fr->last = selwinforselfrm(selmon, 0);
+	setlast(selmon, selmon->selfrm, selwinforselfrm(selmon, 0));
 	if (selmon->selfrm == selmon->focfrm)
 		refocus();
 	else 